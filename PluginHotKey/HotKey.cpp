@@ -0,0 +1,716 @@
+/*
+Copyright (C) 2014 Brian Ferguson
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "HotKey.h"
+#include "InputBackend.h"
+#include <cassert>
+#include <chrono>
+#include <unordered_map>
+
+typedef std::chrono::steady_clock Clock;
+
+// Measures (in load order) and stopped groups of a loaded skin
+struct SkinInfo
+{
+	std::vector<Measure*> measures;
+	std::set<std::wstring> stoppedGroups;	// Upper case group name
+};
+
+static std::vector<Measure*> g_UpMeasures;
+static std::vector<Measure*> g_DownMeasures;
+static std::map<void*, SkinInfo> g_Skins;
+static std::set<Measure*> g_ScopedMeasures;						// Measures with a foreground scope
+static ForegroundInfo g_Foreground;
+static std::map<std::vector<short>, std::vector<Measure*>> g_ChordIndex;
+static std::map<std::wstring, Measure*> g_MeasureIndex;			// Upper case "Config\Measure"
+static std::map<std::wstring, void*> g_SkinIndex;					// Upper case config, skin
+static std::unordered_map<std::wstring, short> g_KeyNames;		// Upper case keyword, virtual-key
+static InputBackend* g_Backend = nullptr;
+static bool g_IsBackendActive = false;
+static bool g_IsBackendInitialized = false;
+static bool g_IsWatchingForeground = false;
+static EngineStats g_Stats;
+static Clock::time_point g_FirstMeasureTime;
+
+void UpdateGroupActive(Measure* measure);
+bool UpdateForegroundWatch();
+void IndexChord(Measure* measure);
+void UnindexChord(Measure* measure);
+
+static std::wstring ToUpper(std::wstring str)
+{
+	std::transform(str.begin(), str.end(), str.begin(), std::towupper);
+	return str;
+}
+
+static double ElapsedMilliseconds(const Clock::time_point& start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+/*
+** One-time setup shared by every measure. Only builds tables in memory, so it is safe to call from
+** DllMain. Also called on first use.
+*/
+void InitializeEngine()
+{
+	if (!g_KeyNames.empty()) return;
+
+	const Clock::time_point start = Clock::now();
+
+	g_KeyNames.reserve(sizeof(g_VirtualKeys) / sizeof(g_VirtualKeys[0]));
+	for (const auto& iter : g_VirtualKeys)
+	{
+		g_KeyNames.emplace(ToUpper(iter.name), iter.number);
+	}
+
+	// Avoid regrowing the lists while many skins are loaded at once
+	g_UpMeasures.reserve(64);
+	g_DownMeasures.reserve(64);
+
+	g_Stats.initTime += ElapsedMilliseconds(start);
+}
+
+const EngineStats& GetEngineStats()
+{
+	return g_Stats;
+}
+
+void SetInputBackend(InputBackend* backend)
+{
+	g_Backend = backend;
+}
+
+InputBackend* GetInputBackend()
+{
+	return g_Backend;
+}
+
+/*
+** Adds the measure to the registry. measure->config and measure->name must already be set.
+*/
+void AddMeasure(Measure* measure)
+{
+	if (g_Stats.measures++ == 0)
+	{
+		g_FirstMeasureTime = Clock::now();
+	}
+
+	// Backend setup (ie. the layout cache) may not be safe in DllMain, so it is done on first use
+	InitializeEngine();
+	assert(g_Backend && "SetInputBackend must be called before AddMeasure");
+	if (g_Backend && !g_IsBackendInitialized)
+	{
+		const Clock::time_point start = Clock::now();
+		g_Backend->Initialize();
+		g_IsBackendInitialized = true;
+		g_Stats.initTime += ElapsedMilliseconds(start);
+	}
+
+	g_Skins[measure->skin].measures.push_back(measure);
+
+	g_MeasureIndex[ToUpper(measure->config + L'\\' + measure->name)] = measure;
+	g_SkinIndex[ToUpper(measure->config)] = measure->skin;
+}
+
+/*
+** Removes the measure from every list. The measure itself is not deleted. Returns false if the
+** backend could not be stopped.
+*/
+bool DeleteMeasure(Measure* measure)
+{
+	const bool isStopped = RemoveMeasure(measure);
+
+	UnindexChord(measure);
+
+	auto name = g_MeasureIndex.find(ToUpper(measure->config + L'\\' + measure->name));
+	if (name != g_MeasureIndex.end() && name->second == measure)
+	{
+		g_MeasureIndex.erase(name);
+	}
+
+	auto skin = g_Skins.find(measure->skin);
+	if (skin != g_Skins.end())
+	{
+		std::vector<Measure*>& measures = skin->second.measures;
+		measures.erase(std::remove(measures.begin(), measures.end(), measure), measures.end());
+
+		// Forget the skin and its stopped groups once its last measure is gone
+		if (measures.empty())
+		{
+			auto config = g_SkinIndex.find(ToUpper(measure->config));
+			if (config != g_SkinIndex.end() && config->second == measure->skin)
+			{
+				g_SkinIndex.erase(config);
+			}
+
+			g_Skins.erase(skin);
+		}
+	}
+
+	g_ScopedMeasures.erase(measure);
+	UpdateForegroundWatch();
+
+	return isStopped;
+}
+
+/*
+** Parses |str| as an unsigned number in |base|. Unlike wcstol, every character must be a valid
+** digit, and parsing stops as soon as the value leaves the virtual-key range.
+*/
+static bool ParseNumber(const WCHAR* str, const int base, long& number)
+{
+	number = 0;
+	if (*str == L'\0') return false;
+
+	for (; *str; ++str)
+	{
+		int digit = base;
+		if (*str >= L'0' && *str <= L'9') digit = *str - L'0';
+		else if (*str >= L'a' && *str <= L'f') digit = *str - L'a' + 10;
+		else if (*str >= L'A' && *str <= L'F') digit = *str - L'A' + 10;
+
+		if (digit >= base) return false;
+
+		number = number * base + digit;
+		if (number > VK_OEM_CLEAR) return false;
+	}
+
+	return true;
+}
+
+/*
+** Parses measure->keys into measure->virtualKeys and updates the hotkey index. See ParseChord for
+** the meaning of the return value and |invalidKey|.
+*/
+ParseResult ParseKeys(Measure* measure, std::wstring& invalidKey)
+{
+	++g_Stats.parses;
+
+	UnindexChord(measure);
+	measure->virtualKeys.clear();
+
+	short status = 0;
+	if (_wcsicmp(measure->keys.c_str(), L"CAPSLOCK STATUS") == 0)
+	{
+		status = VK_CAPITAL;
+		measure->hasToggle = true;
+	}
+	else if (_wcsicmp(measure->keys.c_str(), L"NUMLOCK STATUS") == 0)
+	{
+		status = VK_NUMLOCK;
+		measure->hasToggle = true;
+	}
+	else if (_wcsicmp(measure->keys.c_str(), L"SCROLLLOCK STATUS") == 0)
+	{
+		status = VK_SCROLL;
+		measure->hasToggle = true;
+	}
+	else
+	{
+		measure->hasToggle = measure->toggle = false;
+	}
+
+	if (measure->hasToggle)
+	{
+		measure->toggle = g_Backend && g_Backend->GetToggleState(status, false);
+		measure->virtualKeys.push_back(status);
+	}
+	else
+	{
+		const ParseResult result = ParseChord(measure->keys, measure->virtualKeys, invalidKey);
+		if (result != PARSE_OK) return result;
+	}
+
+	IndexChord(measure);
+	return PARSE_OK;
+}
+
+/*
+** Forgets the parsed keys of the measure, ie. when its "HotKey" option is removed. The measure no
+** longer needs the foreground window either, until its scope is updated again.
+*/
+void ClearKeys(Measure* measure)
+{
+	UnindexChord(measure);
+	measure->keys.clear();
+	measure->virtualKeys.clear();
+	measure->hasToggle = measure->toggle = false;
+
+	g_ScopedMeasures.erase(measure);
+	UpdateForegroundWatch();
+}
+
+/*
+** Parses |keys| into a sorted list of unique virtual-keys. Returns PARSE_INVALID_KEY and sets
+** |invalidKey| if any of the keys is invalid, or PARSE_TOO_MANY_KEYS if there are more than
+** MAX_HOTKEY_KEYS keys. The cost is linear in the length of |keys|, and the result never has more
+** than MAX_HOTKEY_KEYS keys, so the cost of matching each keystroke is bounded as well.
+*/
+ParseResult ParseChord(const std::wstring& keys, std::vector<short>& virtualKeys, std::wstring& invalidKey)
+{
+	InitializeEngine();
+	virtualKeys.clear();
+
+	// Without a backend, single characters cannot be mapped and are reported as invalid
+	assert(g_Backend && "SetInputBackend must be called before ParseChord");
+
+	bool hasAlt = false, hasCtrl = false, hasShift = false;
+
+	const WCHAR* whiteSpace = L" \t\r\n";
+	size_t count = 0;
+
+	for (size_t pos = keys.find_first_not_of(whiteSpace); pos != std::wstring::npos; pos = keys.find_first_not_of(whiteSpace, pos))
+	{
+		size_t end = keys.find_first_of(whiteSpace, pos);
+		if (end == std::wstring::npos) end = keys.size();
+
+		const size_t keySize = end - pos;
+		if (keySize > MAX_KEY_LENGTH)
+		{
+			invalidKey = keys.substr(pos, MAX_KEY_LENGTH) + L"...";
+			virtualKeys.clear();
+			return PARSE_INVALID_KEY;
+		}
+
+		if (++count > MAX_HOTKEY_KEYS)
+		{
+			virtualKeys.clear();
+			return PARSE_TOO_MANY_KEYS;
+		}
+
+		const std::wstring key = keys.substr(pos, keySize);
+		pos = end;
+
+		long number = 0;
+		bool found = false;
+
+		if (keySize == 1 && std::iswprint(key[0]))					// Convert single character
+		{
+			number = g_Backend ? g_Backend->CharToKey(key[0]) : -1;
+			found = true;
+		}
+		else if (keySize > 1 && key[0] == L'0')						// Convert hex, oct, binary to decimal
+		{
+			switch (key[1])
+			{
+			case L'x':
+				if (!ParseNumber(key.c_str() + 2, 16, number)) number = 0;
+				found = true;
+				break;
+
+			case L'o':
+				if (!ParseNumber(key.c_str() + 2, 8, number)) number = 0;
+				found = true;
+				break;
+
+			case L'b':
+				if (!ParseNumber(key.c_str() + 2, 2, number)) number = 0;
+				found = true;
+				break;
+
+			default:
+				break;
+			}
+		}
+		else if (keySize > 1)										// Convert string
+		{
+			auto iter = g_KeyNames.find(ToUpper(key));
+			if (iter != g_KeyNames.end())
+			{
+				number = iter->second;
+				found = true;
+			}
+		}
+
+		if (!found && !ParseNumber(key.c_str(), 10, number))		// Assume key is in decimal form already
+		{
+			number = 0;
+		}
+
+		// Check range, should be between VK_LBUTTON(0x01, 1) and VK_OEM_CLEAR(0xFE, 254)
+		// per http://msdn.microsoft.com/en-us/library/windows/desktop/dd375731(v=vs.85).aspx
+		if (number < VK_LBUTTON || number > VK_OEM_CLEAR)
+		{
+			invalidKey = key;
+			virtualKeys.clear();
+			return PARSE_INVALID_KEY;
+		}
+
+		virtualKeys.push_back((short)number);
+
+		if (number == VK_SHIFT) hasShift = true;
+		else if (number == VK_CONTROL) hasCtrl = true;
+		else if (number == VK_MENU) hasAlt = true;
+	}
+
+	// Sort lowest to highest
+	std::sort(virtualKeys.begin(), virtualKeys.end());
+
+	// Remove duplicates
+	virtualKeys.erase(std::unique(virtualKeys.begin(), virtualKeys.end()), virtualKeys.end());
+
+	// Remove any L/R variations (only if the HotKey has the generic modifier)
+	// ie. SHIFT overrides LSHIFT
+	auto remove = [&](const bool modifier, const short key) -> void
+	{
+		if (modifier)
+		{
+			virtualKeys.erase(
+				std::remove(virtualKeys.begin(), virtualKeys.end(), key),
+				virtualKeys.end());
+		}
+	};
+
+	remove(hasShift, VK_LSHIFT);
+	remove(hasShift, VK_RSHIFT);
+	remove(hasCtrl, VK_LCONTROL);
+	remove(hasCtrl, VK_RCONTROL);
+	remove(hasAlt, VK_LMENU);
+	remove(hasAlt, VK_RMENU);
+
+	virtualKeys.shrink_to_fit();
+	return PARSE_OK;
+}
+
+/*
+** Adds or removes the measure from the global "Up" and "Down" lists based on its actions. Returns
+** false if the backend could not be stopped. Starting the backend is left to the host (see
+** IsBackendNeeded and StartBackend) so that it can be started once after a burst of measures is
+** loaded.
+*/
+bool UpdateMeasureLists(Measure* measure)
+{
+	// If there is an "Up" action, push the measure to the global "Up" list (if it doesn't exist).
+	// Else if there isn't an "Up" action AND the measure is in the global list, remove it.
+	bool isStopped = true;
+	if (std::find(g_UpMeasures.begin(), g_UpMeasures.end(), measure) == g_UpMeasures.end())
+	{
+		if (!measure->upAction.empty())
+		{
+			g_UpMeasures.push_back(measure);
+		}
+	}
+	else if (measure->upAction.empty())
+	{
+		isStopped = RemoveMeasure(measure, true, false);
+	}
+
+	// Add measure to global "Down" list (if it doesn't exist). Also add any "Toggle" measures to
+	// make sure they are updated.
+	if (std::find(g_DownMeasures.begin(), g_DownMeasures.end(), measure) == g_DownMeasures.end())
+	{
+		if (!measure->downAction.empty() || measure->hasToggle || measure->showAllKeys)
+		{
+			g_DownMeasures.push_back(measure);
+		}
+	}
+	else if (measure->downAction.empty())
+	{
+		isStopped = RemoveMeasure(measure, false, true) && isStopped;
+	}
+
+	if (IsBackendNeeded()) ++g_Stats.backendRequests;
+
+	return isStopped;
+}
+
+bool IsBackendNeeded()
+{
+	return !g_IsBackendActive && (!g_UpMeasures.empty() || !g_DownMeasures.empty());
+}
+
+/*
+** Starts the backend if any measure still needs it. Returns false if it could not be started.
+*/
+bool StartBackend()
+{
+	if (!IsBackendNeeded()) return true;
+
+	if (!g_Backend || !g_Backend->Start())
+	{
+		return false;
+	}
+
+	g_IsBackendActive = true;
+
+	if (g_Stats.backendStarts++ == 0)
+	{
+		g_Stats.startupTime = ElapsedMilliseconds(g_FirstMeasureTime);
+	}
+
+	return true;
+}
+
+/*
+** Returns the measures in the global "Up" and "Down" lists, ie. to report a failed StartBackend to
+** each skin.
+*/
+std::vector<Measure*> GetBackendMeasures()
+{
+	std::vector<Measure*> measures = g_UpMeasures;
+	for (const auto& measure : g_DownMeasures)
+	{
+		if (std::find(measures.begin(), measures.end(), measure) == measures.end())
+		{
+			measures.push_back(measure);
+		}
+	}
+
+	return measures;
+}
+
+/*
+** Removes the measure from the global "Up" and/or "Down" lists and stops the backend once both
+** lists are empty. Returns false if the backend could not be stopped, in which case it is still
+** considered active and stopping it is tried again on the next removal.
+*/
+bool RemoveMeasure(Measure* measure, const bool isUp, const bool isDown)
+{
+	auto remove = [&](const bool& state, std::vector<Measure*>& gMeasures) -> void
+	{
+		if (state)
+		{
+			std::vector<Measure*>::iterator found = std::find(gMeasures.begin(), gMeasures.end(), measure);
+			if (found != gMeasures.end())
+			{
+				gMeasures.erase(found);
+			}
+		}
+	};
+
+	remove(isUp, g_UpMeasures);
+	remove(isDown, g_DownMeasures);
+
+	if (g_IsBackendActive && g_UpMeasures.empty() && g_DownMeasures.empty())
+	{
+		if (!g_Backend->Stop())
+		{
+			return false;
+		}
+
+		g_IsBackendActive = false;
+	}
+
+	return true;
+}
+
+/*
+** Refreshes the group state and scope of the measure after its options have changed. Returns false
+** if the foreground window could not be watched.
+*/
+bool UpdateScope(Measure* measure)
+{
+	UpdateGroupActive(measure);
+
+	if (measure->HasScope())
+	{
+		g_ScopedMeasures.insert(measure);
+	}
+	else
+	{
+		g_ScopedMeasures.erase(measure);
+	}
+
+	const bool result = UpdateForegroundWatch();
+	measure->isInScope = IsInScope(measure, g_Foreground);
+	return result;
+}
+
+/*
+** Starts (1), stops (0) or toggles (-1) |group| for every measure in the skin of |measure|.
+*/
+void SetGroupState(Measure* measure, const std::wstring& group, const int state)
+{
+	auto skin = g_Skins.find(measure->skin);
+	if (skin == g_Skins.end()) return;
+
+	std::set<std::wstring>& stoppedGroups = skin->second.stoppedGroups;
+	const std::wstring key = ToUpper(group);
+	const bool isStopped = stoppedGroups.find(key) != stoppedGroups.end();
+	const bool stop = (state == -1) ? !isStopped : (state == 0);
+
+	if (stop)
+	{
+		stoppedGroups.insert(key);
+	}
+	else
+	{
+		stoppedGroups.erase(key);
+	}
+
+	for (auto& other : skin->second.measures)
+	{
+		UpdateGroupActive(other);
+	}
+}
+
+void UpdateGroupActive(Measure* measure)
+{
+	auto skin = g_Skins.find(measure->skin);
+	if (skin == g_Skins.end())
+	{
+		measure->isGroupActive = true;
+		return;
+	}
+
+	const std::set<std::wstring>& stoppedGroups = skin->second.stoppedGroups;
+	measure->isGroupActive = std::none_of(measure->groups.begin(), measure->groups.end(),
+		[&](const std::wstring& group) { return stoppedGroups.find(group) != stoppedGroups.end(); });
+}
+
+/*
+** The foreground window is only watched while at least one measure has a scope. The scoped measures
+** are tracked by UpdateScope, so loading many skins does not rescan every measure.
+*/
+bool UpdateForegroundWatch()
+{
+	const bool isNeeded = !g_ScopedMeasures.empty();
+
+	if (isNeeded != g_IsWatchingForeground)
+	{
+		if (!g_Backend || !g_Backend->WatchForeground(isNeeded))
+		{
+			return false;
+		}
+
+		g_IsWatchingForeground = isNeeded;
+	}
+
+	return true;
+}
+
+/*
+** The chord index is keyed by the parsed (sorted and unique) virtual-keys, so lookups are exact and
+** independent of how the "HotKey" option was written. It is updated whenever a measure's keys are
+** parsed or cleared.
+*/
+void IndexChord(Measure* measure)
+{
+	if (!measure->virtualKeys.empty())
+	{
+		g_ChordIndex[measure->virtualKeys].push_back(measure);
+	}
+}
+
+void UnindexChord(Measure* measure)
+{
+	auto found = g_ChordIndex.find(measure->virtualKeys);
+	if (found != g_ChordIndex.end())
+	{
+		std::vector<Measure*>& measures = found->second;
+		measures.erase(std::remove(measures.begin(), measures.end(), measure), measures.end());
+		if (measures.empty()) g_ChordIndex.erase(found);
+	}
+}
+
+/*
+** Returns the measures bound to |keys|, or nullptr if |keys| is invalid or not bound.
+*/
+const std::vector<Measure*>* FindChord(const std::wstring& keys)
+{
+	std::vector<short> virtualKeys;
+	std::wstring invalidKey;
+	if (ParseChord(keys, virtualKeys, invalidKey) != PARSE_OK) return nullptr;
+
+	auto found = g_ChordIndex.find(virtualKeys);
+	return (found != g_ChordIndex.end()) ? &found->second : nullptr;
+}
+
+/*
+** Returns the measure named |name| in the skin |config|, or nullptr.
+*/
+Measure* FindMeasure(const std::wstring& config, const std::wstring& name)
+{
+	auto found = g_MeasureIndex.find(ToUpper(config + L'\\' + name));
+	return (found != g_MeasureIndex.end()) ? found->second : nullptr;
+}
+
+/*
+** Returns the measures of the skin |config|, or nullptr.
+*/
+const std::vector<Measure*>* FindSkin(const std::wstring& config)
+{
+	auto found = g_SkinIndex.find(ToUpper(config));
+	if (found == g_SkinIndex.end()) return nullptr;
+
+	auto skin = g_Skins.find(found->second);
+	return (skin != g_Skins.end()) ? &skin->second.measures : nullptr;
+}
+
+/*
+** Caches the foreground identity and precomputes the scope of the measures that have one. The other
+** measures are always in scope (see UpdateScope).
+*/
+void OnForegroundChanged(const ForegroundInfo& foreground)
+{
+	g_Foreground = foreground;
+
+	for (auto& measure : g_ScopedMeasures)
+	{
+		measure->isInScope = IsInScope(measure, g_Foreground);
+	}
+}
+
+void OnKeyEvent(const KeyEvent& event)
+{
+	for (auto& measure : (event.isUp ? g_UpMeasures : g_DownMeasures))
+	{
+		// Log keystoke if needed
+		if (measure->showAllKeys)
+		{
+			WCHAR name[32];
+			g_Backend->GetKeyName(event, name, sizeof(name) / sizeof(WCHAR));
+
+			WCHAR message[128];
+			swprintf(message, sizeof(message) / sizeof(WCHAR), L"Key: %ls, Hex: 0x%X (%i), Scan Code: 0x%X (%i), State: %ls, Time: %u",
+				name, event.vk, event.vk, event.scanCode, event.scanCode, event.isUp ? L"Up" : L"Down", event.time);
+			LogKey(measure, message);
+		}
+
+		// Only execute if the measure is active and in scope. The scope is precomputed when the
+		// foreground window changes, so there are no OS calls here.
+		if (measure->isActive && measure->isGroupActive && measure->isInScope)
+		{
+			if (std::find(measure->virtualKeys.begin(), measure->virtualKeys.end(), event.vk) != measure->virtualKeys.end())
+			{
+				bool executeAction = true;
+				for (const auto& key : measure->virtualKeys)
+				{
+					if (key != event.vk && !g_Backend->IsKeyDown(key))
+					{
+						executeAction = false;
+						break;
+					}
+				}
+
+				if (measure->hasToggle)
+				{
+					measure->toggle = g_Backend->GetToggleState(measure->virtualKeys[0], true);
+				}
+
+				// Since toggle keys are added to the "Down" measures no matter what,
+				// make sure there is a down "Action" before executing.
+				if (executeAction && (event.isUp || !measure->downAction.empty()))
+				{
+					ExecuteAction(measure, event.isUp ? measure->upAction : measure->downAction);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,381 @@
+/*
+Copyright (C) 2014 Brian Ferguson
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+** Platform-neutral hotkey engine: key parsing, the measure registry, scope evaluation and key
+** dispatch. Input is provided by an InputBackend (see InputBackend.h) and actions are handed back
+** to the host through ExecuteAction/LogKey.
+*/
+
+#ifndef __HOTKEY_H__
+#define __HOTKEY_H__
+
+#include "Stdafx.h"
+
+struct KeyInfo
+{
+	const WCHAR* name;
+	short number;
+};
+
+const KeyInfo g_VirtualKeys[] =
+{
+	{ L"LBUTTON", VK_LBUTTON },
+	{ L"RBUTTON", VK_RBUTTON },
+	{ L"MBUTTON", VK_MBUTTON },
+	{ L"XBUTTON1", VK_XBUTTON1 },
+	{ L"XBUTTON2", VK_XBUTTON2 },
+	{ L"BACKSPACE", VK_BACK },
+	{ L"TAB", VK_TAB },
+	{ L"ENTER", VK_RETURN },
+	{ L"SHIFT", VK_SHIFT },
+	{ L"CTRL", VK_CONTROL },
+	{ L"ALT", VK_MENU },
+	{ L"PAUSE", VK_PAUSE },
+	{ L"CAPSLOCK", VK_CAPITAL },
+	{ L"ESCAPE", VK_ESCAPE },
+	{ L"SPACE", VK_SPACE },
+	{ L"PAGEUP", VK_PRIOR },
+	{ L"PAGEDOWN", VK_NEXT },
+	{ L"END", VK_END },
+	{ L"HOME", VK_HOME },
+	{ L"LEFT", VK_LEFT },
+	{ L"UP", VK_UP },
+	{ L"RIGHT", VK_RIGHT },
+	{ L"DOWN", VK_DOWN },
+	{ L"PRINTSCREEN", VK_SNAPSHOT },
+	{ L"INSERT", VK_INSERT },
+	{ L"DELETE", VK_DELETE },
+	{ L"LWIN", VK_LWIN },
+	{ L"RWIN", VK_RWIN },
+	{ L"MENU", VK_APPS },
+	{ L"NUM0", VK_NUMPAD0 },
+	{ L"NUM1", VK_NUMPAD1 },
+	{ L"NUM2", VK_NUMPAD2 },
+	{ L"NUM3", VK_NUMPAD3 },
+	{ L"NUM4", VK_NUMPAD4 },
+	{ L"NUM5", VK_NUMPAD5 },
+	{ L"NUM6", VK_NUMPAD6 },
+	{ L"NUM7", VK_NUMPAD7 },
+	{ L"NUM8", VK_NUMPAD8 },
+	{ L"NUM9", VK_NUMPAD9 },
+	{ L"MULT", VK_MULTIPLY },
+	{ L"ADD", VK_ADD },
+	{ L"SUBTRACT", VK_SUBTRACT },
+	{ L"DECIMAL", VK_DECIMAL },
+	{ L"DIVIDE", VK_DIVIDE },
+	{ L"F1", VK_F1 },
+	{ L"F2", VK_F2 },
+	{ L"F3", VK_F3 },
+	{ L"F4", VK_F4 },
+	{ L"F5", VK_F5 },
+	{ L"F6", VK_F6 },
+	{ L"F7", VK_F7 },
+	{ L"F8", VK_F8 },
+	{ L"F9", VK_F9 },
+	{ L"F10", VK_F10 },
+	{ L"F11", VK_F11 },
+	{ L"F12", VK_F12 },
+	{ L"F13", VK_F13 },
+	{ L"F14", VK_F14 },
+	{ L"F15", VK_F15 },
+	{ L"F16", VK_F16 },
+	{ L"F17", VK_F17 },
+	{ L"F18", VK_F18 },
+	{ L"F19", VK_F19 },
+	{ L"F20", VK_F20 },
+	{ L"F21", VK_F21 },
+	{ L"F22", VK_F22 },
+	{ L"F23", VK_F23 },
+	{ L"F24", VK_F24 },
+	{ L"NUMLOCK", VK_NUMLOCK },
+	{ L"SCROLLLOCK", VK_SCROLL },
+	{ L"LSHIFT", VK_LSHIFT },
+	{ L"RSHIFT", VK_RSHIFT },
+	{ L"LCTRL", VK_LCONTROL },
+	{ L"RCTRL", VK_RCONTROL },
+	{ L"LALT", VK_LMENU },
+	{ L"RALT", VK_RMENU },
+	{ L"COLON", VK_OEM_1 },					// :;
+	{ L"PLUS", VK_OEM_PLUS },				// +=
+	{ L"COMMA", VK_OEM_COMMA },				// ,<
+	{ L"MINUS", VK_OEM_MINUS },				// -_
+	{ L"PERIOD", VK_OEM_PERIOD },			// .>
+	{ L"FORWARDSLASH", VK_OEM_2 },			// /?
+	{ L"BACKTICK", VK_OEM_3 },				// `~
+	{ L"LBRACKET", VK_OEM_4 },				// [{
+	{ L"BACKSLASH", VK_OEM_5 },				// \|
+	{ L"RBRACKET", VK_OEM_6 },				// ]}
+	{ L"QUOTE", VK_OEM_7 }					// '"
+};
+
+// Upper bounds for the "HotKey" option. The longest keyword (FORWARDSLASH) and the longest numeric
+// form (ie. 0b11111110) both fit in MAX_KEY_LENGTH.
+const size_t MAX_HOTKEY_KEYS = 16;
+const size_t MAX_KEY_LENGTH = 16;
+
+// Result of parsing the "HotKey" option.
+enum ParseResult
+{
+	PARSE_OK,
+	PARSE_INVALID_KEY,		// A key is unknown, out of range or longer than MAX_KEY_LENGTH
+	PARSE_TOO_MANY_KEYS		// More than MAX_HOTKEY_KEYS keys
+};
+
+// Cached identity of the foreground window. This is only refreshed when the foreground window
+// changes, so the keyboard hook never has to query the OS to evaluate a measure's scope.
+struct ForegroundInfo
+{
+	std::wstring process;					// Executable name (ie. "notepad.exe")
+	std::wstring windowClass;
+
+	ForegroundInfo() :
+		process(),
+		windowClass()
+	{ }
+};
+
+struct Measure
+{
+	std::wstring upAction;
+	std::wstring downAction;
+	std::wstring keys;
+	bool showAllKeys;
+
+	std::wstring config;					// Skin config name (ie. "illustro\Clock")
+	std::wstring name;						// Measure name
+	std::wstring queryResult;				// Keeps the string returned to Rainmeter alive
+
+	std::vector<short> virtualKeys;
+
+	std::vector<std::wstring> groups;		// Upper case
+	std::vector<std::wstring> processes;	// Wildcard patterns matched against ForegroundInfo::process
+	std::vector<std::wstring> windowClasses;	// Wildcard patterns matched against ForegroundInfo::windowClass
+
+	bool toggle;							// Toggle key state
+	bool hasToggle;							// Key is either CapsLock, NumLock, or ScrollLock
+	bool isActive;
+	bool isGroupActive;						// False if any of the measure's groups are stopped
+	bool isInScope;							// Precomputed from the cached ForegroundInfo
+
+	void* skin;
+	void* rm;
+
+	Measure() :
+		upAction(),
+		downAction(),
+		keys(),
+		showAllKeys(false),
+		config(),
+		name(),
+		queryResult(),
+		virtualKeys(),
+		groups(),
+		processes(),
+		windowClasses(),
+		toggle(false),
+		hasToggle(false),
+		isActive(true),
+		isGroupActive(true),
+		isInScope(true),
+		skin(),
+		rm()
+	{ }
+
+	bool HasScope() const { return !processes.empty() || !windowClasses.empty(); }
+};
+
+// A single key transition reported by an InputBackend. |vk| is always in the Windows virtual-key
+// space, regardless of the platform.
+struct KeyEvent
+{
+	short vk;
+	unsigned int scanCode;
+	unsigned int time;
+	bool isUp;
+
+	KeyEvent() :
+		vk(0),
+		scanCode(0),
+		time(0),
+		isUp(false)
+	{ }
+};
+
+// Startup counters
+struct EngineStats
+{
+	unsigned int measures;					// Measures added
+	unsigned int parses;					// "HotKey" options parsed
+	unsigned int backendRequests;			// Times a measure needed the backend while it was not running
+	unsigned int backendStarts;				// Times the backend was actually started
+	double initTime;						// Milliseconds spent in one-time setup
+	double startupTime;						// Milliseconds from the first measure to the first backend start
+
+	EngineStats() :
+		measures(0),
+		parses(0),
+		backendRequests(0),
+		backendStarts(0),
+		initTime(0.0),
+		startupTime(0.0)
+	{ }
+};
+
+class InputBackend;
+
+void InitializeEngine();
+const EngineStats& GetEngineStats();
+
+void SetInputBackend(InputBackend* backend);
+InputBackend* GetInputBackend();
+
+void AddMeasure(Measure* measure);
+bool DeleteMeasure(Measure* measure);
+ParseResult ParseKeys(Measure* measure, std::wstring& invalidKey);
+ParseResult ParseChord(const std::wstring& keys, std::vector<short>& virtualKeys, std::wstring& invalidKey);
+void ClearKeys(Measure* measure);
+bool UpdateMeasureLists(Measure* measure);
+bool IsBackendNeeded();
+bool StartBackend();
+std::vector<Measure*> GetBackendMeasures();
+bool RemoveMeasure(Measure* measure, const bool isUp = true, const bool isDown = true);
+bool UpdateScope(Measure* measure);
+void SetGroupState(Measure* measure, const std::wstring& group, const int state);
+
+// Read-only lookups over every registered measure
+const std::vector<Measure*>* FindChord(const std::wstring& keys);
+Measure* FindMeasure(const std::wstring& config, const std::wstring& name);
+const std::vector<Measure*>* FindSkin(const std::wstring& config);
+
+// Called by the InputBackend
+void OnKeyEvent(const KeyEvent& event);
+void OnForegroundChanged(const ForegroundInfo& foreground);
+
+// Implemented by the host
+void ExecuteAction(Measure* measure, const std::wstring& action);
+void LogKey(Measure* measure, const WCHAR* message);
+
+/*
+** From Rainmeter\ConfigParser.cpp
+**
+** Splits the string from the delimiters.
+** Now trims empty element in vector and white-space in each string.
+**
+** Modified from http://www.digitalpeer.com/id/simple
+*/
+inline std::vector<std::wstring> Tokenize(const std::wstring& str, const std::wstring delimiters = L" ")
+{
+	std::vector<std::wstring> tokens;
+
+	size_t lastPos, pos = 0;
+	do
+	{
+		lastPos = str.find_first_not_of(delimiters, pos);
+
+		if (lastPos == std::wstring::npos)
+			break;
+
+		pos = str.find_first_of(delimiters, lastPos + 1);
+		std::wstring token = str.substr(lastPos, pos - lastPos);	// len = (pos != std::wstring::npos) ? pos - lastPos : pos
+
+		size_t pos2 = token.find_first_not_of(L" \t\r\n");
+		if (pos2 != std::wstring::npos)
+		{
+			size_t lastPos2 = token.find_last_not_of(L" \t\r\n");
+
+			if (pos2 != 0 || lastPos2 != (token.size() - 1))
+			{
+				token.assign(token, pos2, lastPos2 - pos2 + 1);		// Trim white-space
+			}
+
+			tokens.push_back(token);
+		}
+
+		if (pos == std::wstring::npos)
+			break;
+
+		++pos;
+
+	} while (true);
+
+	return tokens;
+}
+
+/*
+** Case-insensitive wildcard match. '*' matches any sequence of characters (including none) and
+** '?' matches any single character. Backtracks only to the most recent '*', so the cost is bounded
+** by the product of the pattern and string lengths.
+*/
+inline bool MatchWildcard(const WCHAR* pattern, const WCHAR* str)
+{
+	const WCHAR* star = nullptr;
+	const WCHAR* retry = nullptr;
+
+	while (*str)
+	{
+		if (*pattern == L'*')
+		{
+			star = pattern++;
+			retry = str;
+		}
+		else if (*pattern == L'?' || (*pattern && std::towupper(*pattern) == std::towupper(*str)))
+		{
+			++pattern;
+			++str;
+		}
+		else if (star)
+		{
+			pattern = star + 1;
+			str = ++retry;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	while (*pattern == L'*') ++pattern;
+
+	return *pattern == L'\0';
+}
+
+/*
+** Determines if the measure should respond to keys while |foreground| is the foreground window.
+** Each non-empty pattern list must have at least one match. Measures without any patterns are
+** always in scope.
+*/
+inline bool IsInScope(const Measure* measure, const ForegroundInfo& foreground)
+{
+	auto matchAny = [](const std::vector<std::wstring>& patterns, const std::wstring& str) -> bool
+	{
+		if (patterns.empty()) return true;
+
+		for (const auto& pattern : patterns)
+		{
+			if (MatchWildcard(pattern.c_str(), str.c_str())) return true;
+		}
+
+		return false;
+	};
+
+	return matchAny(measure->processes, foreground.process) &&
+		matchAny(measure->windowClasses, foreground.windowClass);
+}
+
+#endif
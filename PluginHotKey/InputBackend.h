@@ -0,0 +1,57 @@
+/*
+Copyright (C) 2014 Brian Ferguson
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef __INPUTBACKEND_H__
+#define __INPUTBACKEND_H__
+
+#include "HotKey.h"
+
+/*
+** Source of key events and key state for the engine. A backend reports key transitions through
+** OnKeyEvent() and foreground window changes through OnForegroundChanged(), both on the thread
+** that owns the engine. All key codes are in the Windows virtual-key space.
+*/
+class InputBackend
+{
+public:
+	virtual ~InputBackend() { }
+
+	// One-time setup, done when the first measure is added
+	virtual void Initialize() { }
+
+	// Starts/stops reporting key events
+	virtual bool Start() = 0;
+	virtual bool Stop() = 0;
+
+	// Starts/stops reporting foreground window changes. When started, the backend reports the
+	// current foreground window immediately.
+	virtual bool WatchForeground(const bool watch) = 0;
+
+	virtual bool IsKeyDown(const short vk) = 0;
+
+	// Returns the on/off state of CapsLock, NumLock or ScrollLock. |isKeyEvent| is true when called
+	// while a key event is being dispatched, in which case the state after the event is returned.
+	virtual bool GetToggleState(const short vk, const bool isKeyEvent) = 0;
+
+	// Returns the virtual-key for a printable character in the current layout, or -1.
+	virtual short CharToKey(const WCHAR ch) = 0;
+
+	virtual void GetKeyName(const KeyEvent& event, WCHAR* buffer, const size_t size) = 0;
+};
+
+#endif
@@ -0,0 +1,396 @@
+/*
+Copyright (C) 2014 Brian Ferguson
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "LinuxBackend.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <unistd.h>
+
+struct KeyCodeInfo
+{
+	unsigned short code;
+	short vk;
+};
+
+static const KeyCodeInfo c_KeyCodes[] =
+{
+	{ BTN_LEFT, VK_LBUTTON },
+	{ BTN_RIGHT, VK_RBUTTON },
+	{ BTN_MIDDLE, VK_MBUTTON },
+	{ BTN_SIDE, VK_XBUTTON1 },
+	{ BTN_EXTRA, VK_XBUTTON2 },
+	{ KEY_BACKSPACE, VK_BACK },
+	{ KEY_TAB, VK_TAB },
+	{ KEY_ENTER, VK_RETURN },
+	{ KEY_KPENTER, VK_RETURN },
+	{ KEY_LEFTSHIFT, VK_LSHIFT },
+	{ KEY_RIGHTSHIFT, VK_RSHIFT },
+	{ KEY_LEFTCTRL, VK_LCONTROL },
+	{ KEY_RIGHTCTRL, VK_RCONTROL },
+	{ KEY_LEFTALT, VK_LMENU },
+	{ KEY_RIGHTALT, VK_RMENU },
+	{ KEY_PAUSE, VK_PAUSE },
+	{ KEY_CAPSLOCK, VK_CAPITAL },
+	{ KEY_ESC, VK_ESCAPE },
+	{ KEY_SPACE, VK_SPACE },
+	{ KEY_PAGEUP, VK_PRIOR },
+	{ KEY_PAGEDOWN, VK_NEXT },
+	{ KEY_END, VK_END },
+	{ KEY_HOME, VK_HOME },
+	{ KEY_LEFT, VK_LEFT },
+	{ KEY_UP, VK_UP },
+	{ KEY_RIGHT, VK_RIGHT },
+	{ KEY_DOWN, VK_DOWN },
+	{ KEY_SYSRQ, VK_SNAPSHOT },
+	{ KEY_INSERT, VK_INSERT },
+	{ KEY_DELETE, VK_DELETE },
+	{ KEY_0, '0' },
+	{ KEY_1, '1' },
+	{ KEY_2, '2' },
+	{ KEY_3, '3' },
+	{ KEY_4, '4' },
+	{ KEY_5, '5' },
+	{ KEY_6, '6' },
+	{ KEY_7, '7' },
+	{ KEY_8, '8' },
+	{ KEY_9, '9' },
+	{ KEY_A, 'A' },
+	{ KEY_B, 'B' },
+	{ KEY_C, 'C' },
+	{ KEY_D, 'D' },
+	{ KEY_E, 'E' },
+	{ KEY_F, 'F' },
+	{ KEY_G, 'G' },
+	{ KEY_H, 'H' },
+	{ KEY_I, 'I' },
+	{ KEY_J, 'J' },
+	{ KEY_K, 'K' },
+	{ KEY_L, 'L' },
+	{ KEY_M, 'M' },
+	{ KEY_N, 'N' },
+	{ KEY_O, 'O' },
+	{ KEY_P, 'P' },
+	{ KEY_Q, 'Q' },
+	{ KEY_R, 'R' },
+	{ KEY_S, 'S' },
+	{ KEY_T, 'T' },
+	{ KEY_U, 'U' },
+	{ KEY_V, 'V' },
+	{ KEY_W, 'W' },
+	{ KEY_X, 'X' },
+	{ KEY_Y, 'Y' },
+	{ KEY_Z, 'Z' },
+	{ KEY_LEFTMETA, VK_LWIN },
+	{ KEY_RIGHTMETA, VK_RWIN },
+	{ KEY_COMPOSE, VK_APPS },
+	{ KEY_KP0, VK_NUMPAD0 },
+	{ KEY_KP1, VK_NUMPAD1 },
+	{ KEY_KP2, VK_NUMPAD2 },
+	{ KEY_KP3, VK_NUMPAD3 },
+	{ KEY_KP4, VK_NUMPAD4 },
+	{ KEY_KP5, VK_NUMPAD5 },
+	{ KEY_KP6, VK_NUMPAD6 },
+	{ KEY_KP7, VK_NUMPAD7 },
+	{ KEY_KP8, VK_NUMPAD8 },
+	{ KEY_KP9, VK_NUMPAD9 },
+	{ KEY_KPASTERISK, VK_MULTIPLY },
+	{ KEY_KPPLUS, VK_ADD },
+	{ KEY_KPMINUS, VK_SUBTRACT },
+	{ KEY_KPDOT, VK_DECIMAL },
+	{ KEY_KPSLASH, VK_DIVIDE },
+	{ KEY_F1, VK_F1 },
+	{ KEY_F2, VK_F2 },
+	{ KEY_F3, VK_F3 },
+	{ KEY_F4, VK_F4 },
+	{ KEY_F5, VK_F5 },
+	{ KEY_F6, VK_F6 },
+	{ KEY_F7, VK_F7 },
+	{ KEY_F8, VK_F8 },
+	{ KEY_F9, VK_F9 },
+	{ KEY_F10, VK_F10 },
+	{ KEY_F11, VK_F11 },
+	{ KEY_F12, VK_F12 },
+	{ KEY_F13, VK_F13 },
+	{ KEY_F14, VK_F14 },
+	{ KEY_F15, VK_F15 },
+	{ KEY_F16, VK_F16 },
+	{ KEY_F17, VK_F17 },
+	{ KEY_F18, VK_F18 },
+	{ KEY_F19, VK_F19 },
+	{ KEY_F20, VK_F20 },
+	{ KEY_F21, VK_F21 },
+	{ KEY_F22, VK_F22 },
+	{ KEY_F23, VK_F23 },
+	{ KEY_F24, VK_F24 },
+	{ KEY_NUMLOCK, VK_NUMLOCK },
+	{ KEY_SCROLLLOCK, VK_SCROLL },
+	{ KEY_MUTE, VK_VOLUME_MUTE },
+	{ KEY_VOLUMEDOWN, VK_VOLUME_DOWN },
+	{ KEY_VOLUMEUP, VK_VOLUME_UP },
+	{ KEY_NEXTSONG, VK_MEDIA_NEXT_TRACK },
+	{ KEY_PREVIOUSSONG, VK_MEDIA_PREV_TRACK },
+	{ KEY_STOPCD, VK_MEDIA_STOP },
+	{ KEY_PLAYPAUSE, VK_MEDIA_PLAY_PAUSE },
+	{ KEY_SEMICOLON, VK_OEM_1 },
+	{ KEY_EQUAL, VK_OEM_PLUS },
+	{ KEY_COMMA, VK_OEM_COMMA },
+	{ KEY_MINUS, VK_OEM_MINUS },
+	{ KEY_DOT, VK_OEM_PERIOD },
+	{ KEY_SLASH, VK_OEM_2 },
+	{ KEY_GRAVE, VK_OEM_3 },
+	{ KEY_LEFTBRACE, VK_OEM_4 },
+	{ KEY_BACKSLASH, VK_OEM_5 },
+	{ KEY_RIGHTBRACE, VK_OEM_6 },
+	{ KEY_APOSTROPHE, VK_OEM_7 },
+	{ KEY_102ND, VK_OEM_102 }
+};
+
+LinuxBackend::LinuxBackend(int fd) :
+	m_Fd(fd),
+	m_IsStarted(false),
+	m_IsWatching(false),
+	m_Foreground(),
+	m_KeyState(),
+	m_ToggleState(),
+	m_Buffer(),
+	m_BufferSize(0)
+{
+}
+
+LinuxBackend::~LinuxBackend()
+{
+}
+
+/*
+** Opens an evdev device for non-blocking reads. The caller owns the returned descriptor.
+*/
+int LinuxBackend::OpenDevice(const char* path)
+{
+	return open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+}
+
+/*
+** Returns the virtual-key for a Linux key code, or 0 if there is none.
+*/
+short LinuxBackend::KeyCodeToVirtualKey(const unsigned int code)
+{
+	// Flattened once so that each event is a single lookup
+	static const std::vector<short> c_Map = []()
+	{
+		std::vector<short> map(KEY_CNT, 0);
+		for (const auto& iter : c_KeyCodes)
+		{
+			map[iter.code] = iter.vk;
+		}
+		return map;
+	}();
+
+	return code < c_Map.size() ? c_Map[code] : 0;
+}
+
+/*
+** Reads the pending events once and dispatches them. Returns the number of key events read, or -1
+** once the descriptor has been closed or has failed.
+*/
+int LinuxBackend::Dispatch()
+{
+	ssize_t bytes = 0;
+	do
+	{
+		bytes = read(m_Fd, m_Buffer + m_BufferSize, sizeof(m_Buffer) - m_BufferSize);
+	} while (bytes < 0 && errno == EINTR);
+
+	if (bytes < 0)
+	{
+		return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+	}
+	else if (bytes == 0)
+	{
+		return -1;
+	}
+
+	m_BufferSize += (size_t)bytes;
+
+	int count = 0;
+	size_t offset = 0;
+	while (m_BufferSize - offset >= sizeof(struct input_event))
+	{
+		struct input_event event;
+		memcpy(&event, m_Buffer + offset, sizeof(event));
+		offset += sizeof(event);
+
+		if (ProcessEvent(event)) ++count;
+	}
+
+	// Keep any partial event for the next read
+	memmove(m_Buffer, m_Buffer + offset, m_BufferSize - offset);
+	m_BufferSize -= offset;
+
+	return count;
+}
+
+void LinuxBackend::SetForeground(const ForegroundInfo& foreground)
+{
+	m_Foreground = foreground;
+
+	if (m_IsWatching)
+	{
+		OnForegroundChanged(m_Foreground);
+	}
+}
+
+bool LinuxBackend::Start()
+{
+	m_IsStarted = m_Fd >= 0;
+	return m_IsStarted;
+}
+
+bool LinuxBackend::Stop()
+{
+	m_IsStarted = false;
+	return true;
+}
+
+bool LinuxBackend::WatchForeground(const bool watch)
+{
+	m_IsWatching = watch;
+
+	if (m_IsWatching)
+	{
+		OnForegroundChanged(m_Foreground);
+	}
+
+	return true;
+}
+
+bool LinuxBackend::IsKeyDown(const short vk)
+{
+	switch (vk)
+	{
+	case VK_SHIFT: return m_KeyState[VK_LSHIFT] || m_KeyState[VK_RSHIFT];
+	case VK_CONTROL: return m_KeyState[VK_LCONTROL] || m_KeyState[VK_RCONTROL];
+	case VK_MENU: return m_KeyState[VK_LMENU] || m_KeyState[VK_RMENU];
+	}
+
+	return m_KeyState[vk & 0xFF];
+}
+
+bool LinuxBackend::GetToggleState(const short vk, const bool /*isKeyEvent*/)
+{
+	// The toggle state is updated before the event is dispatched, so it is the same either way
+	return m_ToggleState[vk & 0xFF];
+}
+
+/*
+** Assumes a US layout.
+*/
+short LinuxBackend::CharToKey(const WCHAR ch)
+{
+	static const WCHAR* c_ShiftedDigits = L")!@#$%^&*(";
+
+	const WCHAR upper = (WCHAR)std::towupper(ch);
+	if ((upper >= L'A' && upper <= L'Z') || (upper >= L'0' && upper <= L'9'))
+	{
+		return (short)upper;
+	}
+
+	const WCHAR* digit = wcschr(c_ShiftedDigits, ch);
+	if (ch != L'\0' && digit)
+	{
+		return (short)(L'0' + (digit - c_ShiftedDigits));
+	}
+
+	switch (ch)
+	{
+	case L' ': return VK_SPACE;
+	case L';': case L':': return VK_OEM_1;
+	case L'=': case L'+': return VK_OEM_PLUS;
+	case L',': case L'<': return VK_OEM_COMMA;
+	case L'-': case L'_': return VK_OEM_MINUS;
+	case L'.': case L'>': return VK_OEM_PERIOD;
+	case L'/': case L'?': return VK_OEM_2;
+	case L'`': case L'~': return VK_OEM_3;
+	case L'[': case L'{': return VK_OEM_4;
+	case L'\\': case L'|': return VK_OEM_5;
+	case L']': case L'}': return VK_OEM_6;
+	case L'\'': case L'"': return VK_OEM_7;
+	}
+
+	return -1;
+}
+
+void LinuxBackend::GetKeyName(const KeyEvent& event, WCHAR* buffer, const size_t size)
+{
+	if (size == 0) return;
+
+	const WCHAR* name = L"Unknown Key";
+	WCHAR character[2] = { (WCHAR)event.vk, L'\0' };
+	if ((event.vk >= L'A' && event.vk <= L'Z') || (event.vk >= L'0' && event.vk <= L'9'))
+	{
+		name = character;
+	}
+	else
+	{
+		for (const auto& iter : g_VirtualKeys)
+		{
+			if (iter.number == event.vk)
+			{
+				name = iter.name;
+				break;
+			}
+		}
+	}
+
+	wcsncpy(buffer, name, size - 1);
+	buffer[size - 1] = L'\0';
+}
+
+/*
+** Updates the key state from an evdev event and reports key transitions. Returns true for key events.
+*/
+bool LinuxBackend::ProcessEvent(const struct input_event& event)
+{
+	if (event.type != EV_KEY) return false;
+
+	const short vk = KeyCodeToVirtualKey(event.code);
+	if (vk == 0) return false;
+
+	// Auto-repeat (value 2) is reported as another key down, like the Windows hook
+	const bool isUp = event.value == 0;
+	const bool wasDown = m_KeyState[vk];
+	m_KeyState[vk] = !isUp;
+
+	if (!isUp && !wasDown && (vk == VK_CAPITAL || vk == VK_NUMLOCK || vk == VK_SCROLL))
+	{
+		m_ToggleState[vk] = !m_ToggleState[vk];
+	}
+
+	if (m_IsStarted)
+	{
+		KeyEvent keyEvent;
+		keyEvent.vk = vk;
+		keyEvent.scanCode = event.code;
+		keyEvent.time = (unsigned int)(event.input_event_sec * 1000 + event.input_event_usec / 1000);
+		keyEvent.isUp = isUp;
+		OnKeyEvent(keyEvent);
+	}
+
+	return true;
+}
@@ -0,0 +1,67 @@
+/*
+Copyright (C) 2014 Brian Ferguson
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef __LINUXBACKEND_H__
+#define __LINUXBACKEND_H__
+
+#include "InputBackend.h"
+
+/*
+** Backend reading struct input_event records from an evdev-style file descriptor (ie.
+** /dev/input/eventN, a uinput virtual device, or a pipe fed by a test). Linux key codes are mapped
+** to the Windows virtual-key space and the key/toggle state is tracked from the events themselves.
+**
+** There is no hook thread: the owner calls Dispatch() whenever the descriptor is readable. Linux has
+** no common notion of a foreground window, so it is supplied through SetForeground().
+*/
+class LinuxBackend : public InputBackend
+{
+public:
+	LinuxBackend(int fd);
+	virtual ~LinuxBackend();
+
+	static int OpenDevice(const char* path);
+	static short KeyCodeToVirtualKey(const unsigned int code);
+
+	int Dispatch();
+	void SetForeground(const ForegroundInfo& foreground);
+
+	virtual bool Start();
+	virtual bool Stop();
+	virtual bool WatchForeground(const bool watch);
+	virtual bool IsKeyDown(const short vk);
+	virtual bool GetToggleState(const short vk, const bool isKeyEvent);
+	virtual short CharToKey(const WCHAR ch);
+	virtual void GetKeyName(const KeyEvent& event, WCHAR* buffer, const size_t size);
+
+private:
+	bool ProcessEvent(const struct input_event& event);
+
+	int m_Fd;
+	bool m_IsStarted;
+	bool m_IsWatching;
+	ForegroundInfo m_Foreground;
+
+	bool m_KeyState[256];
+	bool m_ToggleState[256];
+
+	char m_Buffer[64 * 24];				// Room for 64 events, plus any partial event from the last read
+	size_t m_BufferSize;
+};
+
+#endif
@@ -16,21 +16,25 @@ along with this program; if not, write to the Free Software
 Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 
-#include "PluginHotKey.h"
+#include "HotKey.h"
+#include "Win32Backend.h"
+#include "../RainmeterAPI/RainmeterAPI.h"
 
-static std::vector<Measure*> g_UpMeasures;
-static std::vector<Measure*> g_DownMeasures;
-static HINSTANCE g_Instance = nullptr;
-static HHOOK g_Hook = nullptr;
-static bool g_IsHookActive = false;
+static Win32Backend g_Backend;
+static UINT_PTR g_StartTimer = 0;
 
-void RemoveMeasure(Measure* measure, const bool isUp = true, const bool isDown = true);
-void ParseKeys(Measure* measure);
-LRESULT CALLBACK LLKeyboardProc(int nCode, WPARAM wParam, LPARAM lParam);
+// The keyboard hook is started once no measure has asked for it for this long, so that it is only
+// installed once while Rainmeter loads many skins at the same time.
+const UINT g_StartDelay = 250;
+
+void ScheduleBackendStart();
+void CALLBACK StartTimerProc(HWND hwnd, UINT uMsg, UINT_PTR idEvent, DWORD dwTime);
 
 LPCWSTR g_ErrRange = L"Invalid HotKey: %s";
+LPCWSTR g_ErrTooMany = L"Too many keys in HotKey (maximum is %i).";
 LPCWSTR g_ErrEmpty = L"Missing \"Keys\" option.";
 LPCWSTR g_ErrHook = L"Could not %s the keyboard hook.";
+LPCWSTR g_ErrEventHook = L"Could not start the foreground window hook.";
 LPCWSTR g_ErrCommand = L"Invalid command: %s";
 
 BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpvReserved)
@@ -38,7 +42,9 @@ BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpvReserved)
 	switch (fdwReason)
 	{
 	case DLL_PROCESS_ATTACH:
-		g_Instance = hinstDLL;
+		g_Backend.SetInstance(hinstDLL);
+		SetInputBackend(&g_Backend);
+		InitializeEngine();
 
 		// Disable DLL_THREAD_ATTACH and DLL_THREAD_DETACH notification calls
 		DisableThreadLibraryCalls(hinstDLL);
@@ -55,6 +61,10 @@ PLUGIN_EXPORT void Initialize(void** data, void* rm)
 
 	measure->skin = RmGetSkin(rm);
 	measure->rm = rm;
+	measure->config = RmGetSkinName(rm);
+	measure->name = RmGetMeasureName(rm);
+
+	AddMeasure(measure);
 }
 
 PLUGIN_EXPORT void Reload(void* data, void* rm, double* maxValue)
@@ -65,7 +75,11 @@ PLUGIN_EXPORT void Reload(void* data, void* rm, double* maxValue)
 	if (keys.empty())
 	{
 		RmLog(rm, LOG_WARNING, g_ErrEmpty);
-		RemoveMeasure(measure);
+		if (!RemoveMeasure(measure))
+		{
+			RmLogF(rm, LOG_ERROR, g_ErrHook, L"stop");
+		}
+		ClearKeys(measure);
 		return;
 	}
 
@@ -73,91 +87,58 @@ PLUGIN_EXPORT void Reload(void* data, void* rm, double* maxValue)
 	measure->downAction = RmReadString(rm, L"KeyDownAction", L"", FALSE);
 	measure->showAllKeys = RmReadInt(rm, L"ShowAllKeys", 0) != 0;
 
+	// Scope options are separated by "|", like the Rainmeter "Group" option
+	measure->groups = Tokenize(RmReadString(rm, L"Group", L""), L"|");
+	for (auto& group : measure->groups)
+	{
+		std::transform(group.begin(), group.end(), group.begin(), std::towupper);
+	}
+	measure->processes = Tokenize(RmReadString(rm, L"ForegroundProcess", L""), L"|");
+	measure->windowClasses = Tokenize(RmReadString(rm, L"ForegroundClass", L""), L"|");
+
+	if (!UpdateScope(measure))
+	{
+		RmLog(rm, LOG_ERROR, g_ErrEventHook);
+	}
+
 	// Only update if the "HotKey" option was changed
 	if (keys != measure->keys)
 	{
 		measure->keys = keys;
-		measure->virtualKeys.clear();
 
-		short status = 0;
-		if (_wcsicmp(keys.c_str(), L"CAPSLOCK STATUS") == 0)
-		{
-			status = VK_CAPITAL;
-			measure->hasToggle = true;
-		}
-		else if (_wcsicmp(keys.c_str(), L"NUMLOCK STATUS") == 0)
+		std::wstring invalidKey;
+		const ParseResult result = ParseKeys(measure, invalidKey);
+		if (result != PARSE_OK)
 		{
-			status = VK_NUMLOCK;
-			measure->hasToggle = true;
-		}
-		else if (_wcsicmp(keys.c_str(), L"SCROLLLOCK STATUS") == 0)
-		{
-			status = VK_SCROLL;
-			measure->hasToggle = true;
-		}
-		else
-		{
-			measure->hasToggle = measure->toggle = false;
-		}
-
-		if (measure->hasToggle)
-		{
-			measure->toggle = LOWORD(GetKeyState(status)) ? true : false;
-			if (!measure->downAction.empty())
+			if (result == PARSE_TOO_MANY_KEYS)
 			{
-				RmExecute(measure->skin, measure->downAction.c_str());
+				RmLogF(rm, LOG_ERROR, g_ErrTooMany, (int)MAX_HOTKEY_KEYS);
+			}
+			else
+			{
+				RmLogF(rm, LOG_ERROR, g_ErrRange, invalidKey.c_str());
 			}
 
-			measure->virtualKeys.push_back(status);
-		}
-		else
-		{
-			ParseKeys(measure);
-		}
-
-		// If there is an "Up" action, push the measure to the global "Up" list (if it doesn't exist).
-		// Else if there isn't an "Up" action AND the measure is in the global list, remove it.
-		if (std::find(g_UpMeasures.begin(), g_UpMeasures.end(), measure) == g_UpMeasures.end())
-		{
-			if (!measure->upAction.empty())
+			if (!RemoveMeasure(measure))
 			{
-				g_UpMeasures.push_back(measure);
+				RmLogF(rm, LOG_ERROR, g_ErrHook, L"stop");
 			}
-		}
-		else if (measure->upAction.empty())
-		{
-			RemoveMeasure(measure, true, false);
+			return;
 		}
 
-		// Add measure to global "Down" list (if it doesn't exist). Also add any "Toggle" measures to
-		// make sure they are updated.
-		if (std::find(g_DownMeasures.begin(), g_DownMeasures.end(), measure) == g_DownMeasures.end())
+		if (measure->hasToggle && !measure->downAction.empty())
 		{
-			if (!measure->downAction.empty() || measure->hasToggle || measure->showAllKeys)
-			{
-				g_DownMeasures.push_back(measure);
-			}
+			RmExecute(measure->skin, measure->downAction.c_str());
 		}
-		else if (measure->downAction.empty())
+
+		if (!UpdateMeasureLists(measure))
 		{
-			RemoveMeasure(measure, false, true);
+			RmLogF(rm, LOG_ERROR, g_ErrHook, L"stop");
 		}
 
-		// Start the keyboard hook
-		if (!g_IsHookActive &&
-			((!measure->upAction.empty() || !measure->downAction.empty() || measure->hasToggle || measure->showAllKeys) &&
-			(g_UpMeasures.size() + g_DownMeasures.size()) >= 1))
+		if (IsBackendNeeded())
 		{
-			g_Hook = SetWindowsHookEx(WH_KEYBOARD_LL, LLKeyboardProc, g_Instance, NULL);
-			if (g_Hook)
-			{
-				g_IsHookActive = true;
-			}
-			else
-			{
-				RmLogF(rm, LOG_ERROR, g_ErrHook, L"start");
-				RemoveMeasure(measure);
-			}
+			ScheduleBackendStart();
 		}
 	}
 }
@@ -171,14 +152,35 @@ PLUGIN_EXPORT double Update(void* data)
 PLUGIN_EXPORT void Finalize(void* data)
 {
 	Measure* measure = (Measure*)data;
-	RemoveMeasure(measure);
+	if (!DeleteMeasure(measure))
+	{
+		RmLogF(measure->rm, LOG_ERROR, g_ErrHook, L"stop");
+	}
 	delete measure;
+
+	// Make sure the timer cannot fire after the plugin is unloaded
+	if (g_StartTimer && !IsBackendNeeded())
+	{
+		KillTimer(nullptr, g_StartTimer);
+		g_StartTimer = 0;
+	}
 }
 
 PLUGIN_EXPORT void ExecuteBang(void* data, LPCWSTR args)
 {
 	Measure* measure = (Measure*)data;
 
+	// Group commands are in the form of "StartGroup Name"
+	std::wstring command = args;
+	std::wstring group;
+	const size_t pos = command.find_first_of(L" \t");
+	if (pos != std::wstring::npos)
+	{
+		const size_t start = command.find_first_not_of(L" \t", pos);
+		if (start != std::wstring::npos) group = command.substr(start);
+		command.erase(pos);
+	}
+
 	if (_wcsicmp(args, L"Start") == 0)
 	{
 		measure->isActive = true;
@@ -191,224 +193,169 @@ PLUGIN_EXPORT void ExecuteBang(void* data, LPCWSTR args)
 	{
 		measure->isActive = !measure->isActive;
 	}
+	else if (!group.empty() && _wcsicmp(command.c_str(), L"StartGroup") == 0)
+	{
+		SetGroupState(measure, group, 1);
+	}
+	else if (!group.empty() && _wcsicmp(command.c_str(), L"StopGroup") == 0)
+	{
+		SetGroupState(measure, group, 0);
+	}
+	else if (!group.empty() && _wcsicmp(command.c_str(), L"ToggleGroup") == 0)
+	{
+		SetGroupState(measure, group, -1);
+	}
 	else
 	{
 		RmLogF(measure->rm, LOG_WARNING, g_ErrCommand, args);
 	}
 }
 
-void RemoveMeasure(Measure* measure, const bool isUp, const bool isDown)
+/*
+** Section variables for querying the hotkeys of every loaded skin. Requires Rainmeter 4.1 or later.
+** Lists are separated by "|" and measures are given as "Config\Measure".
+*/
+
+// [&Measure:FindHotKey(CTRL ALT X)] - Measures bound to exactly the given keys
+PLUGIN_EXPORT LPCWSTR FindHotKey(void* data, const int argc, const WCHAR* argv[])
 {
-	auto remove = [&](const bool& state, std::vector<Measure*>& gMeasures) -> void
+	Measure* measure = (Measure*)data;
+	measure->queryResult.clear();
+
+	const std::vector<Measure*>* measures = (argc == 1) ? FindChord(argv[0]) : nullptr;
+	if (measures)
 	{
-		if (state)
+		for (const auto& found : *measures)
 		{
-			std::vector<Measure*>::iterator found = std::find(gMeasures.begin(), gMeasures.end(), measure);
-			if (found != gMeasures.end())
-			{
-				gMeasures.erase(found);
-			}
+			if (!measure->queryResult.empty()) measure->queryResult += L'|';
+			measure->queryResult += found->config;
+			measure->queryResult += L'\\';
+			measure->queryResult += found->name;
 		}
-	};
+	}
 
-	remove(isUp, g_UpMeasures);
-	remove(isDown, g_DownMeasures);
+	return measure->queryResult.c_str();
+}
 
-	if (g_IsHookActive && g_UpMeasures.empty() && g_DownMeasures.empty())
-	{
-		while (g_Hook && UnhookWindowsHookEx(g_Hook) == FALSE)
-		{
-			RmLogF(measure->rm, LOG_ERROR, g_ErrHook, L"stop");
-		}
+// [&Measure:CountHotKey(CTRL ALT X)] - Number of measures bound to exactly the given keys
+PLUGIN_EXPORT LPCWSTR CountHotKey(void* data, const int argc, const WCHAR* argv[])
+{
+	Measure* measure = (Measure*)data;
 
-		g_Hook = nullptr;
-		g_IsHookActive = false;
-	}
+	const std::vector<Measure*>* measures = (argc == 1) ? FindChord(argv[0]) : nullptr;
+	measure->queryResult = std::to_wstring(measures ? measures->size() : 0);
+
+	return measure->queryResult.c_str();
 }
 
-void ParseKeys(Measure* measure)
+// [&Measure:GetHotKey(MeasureName)] or [&Measure:GetHotKey(MeasureName, Config)] - HotKey option of a
+// measure in the current skin or in another skin
+PLUGIN_EXPORT LPCWSTR GetHotKey(void* data, const int argc, const WCHAR* argv[])
 {
-	bool hasAlt = false, hasCtrl = false, hasShift = false;
+	Measure* measure = (Measure*)data;
+	measure->queryResult.clear();
 
-	std::vector<std::wstring> tokens = Tokenize(measure->keys);
-	for (auto& key : tokens)
+	if (argc == 1 || argc == 2)
 	{
-		long number = 0;
-		size_t keySize = key.size();
-		bool found = false;
+		const Measure* found = FindMeasure((argc == 2) ? argv[1] : measure->config, argv[0]);
+		if (found && !found->virtualKeys.empty()) measure->queryResult = found->keys;
+	}
 
-		if (keySize == 1 && std::iswprint(key[0]))					// Convert single character
-		{
-			number = LOBYTE(VkKeyScanEx(key[0], GetKeyboardLayout(0)));
-			found = true;
-		}
-		else if (keySize > 1 && key[0] == L'0')						// Convert hex, oct, binary to decimal
-		{
-			switch (key[1])
-			{
-			case L'x':
-				number = wcstol(key.c_str(), nullptr, 16);
-				found = true;
-				break;
-
-			case L'o':
-				number = wcstol(key.c_str() + 2, nullptr, 8);
-				found = true;
-				break;
-
-			case L'b':
-				number = wcstol(key.c_str() + 2, nullptr, 2);
-				found = true;
-				break;
-
-			default:
-				break;
-			}
-		}
-		else if (keySize > 1)										// Convert string
-		{
-			for (const auto& iter : g_VirtualKeys)
-			{
-				if (_wcsicmp(key.c_str(), iter.name) == 0)
-				{
-					number = iter.number;
-					found = true;
-					break;
-				}
-			}
-		}
+	return measure->queryResult.c_str();
+}
 
-		if (!found)													// Assume key is in decimal form already
-		{
-			number = wcstol(key.c_str(), nullptr, 10);
-		}
+// [&Measure:GetSkinHotKeys()] or [&Measure:GetSkinHotKeys(Config)] - "Measure=HotKey" pairs of the
+// current skin or of another skin
+PLUGIN_EXPORT LPCWSTR GetSkinHotKeys(void* data, const int argc, const WCHAR* argv[])
+{
+	Measure* measure = (Measure*)data;
+	measure->queryResult.clear();
 
-		// Check range, should be between VK_LBUTTON(0x01, 1) and VK_OEM_CLEAR(0xFE, 254)
-		// per http://msdn.microsoft.com/en-us/library/windows/desktop/dd375731(v=vs.85).aspx
-		if (number < VK_LBUTTON || number > VK_OEM_CLEAR)
+	const std::vector<Measure*>* measures = (argc <= 1) ? FindSkin((argc == 1) ? argv[0] : measure->config) : nullptr;
+	if (measures)
+	{
+		for (const auto& found : *measures)
 		{
-			RmLogF(measure->rm, LOG_ERROR, g_ErrRange, key.c_str());
-			RemoveMeasure(measure);
-			return;
-		}
+			if (found->virtualKeys.empty()) continue;
 
-		measure->virtualKeys.push_back((short)number);
-
-		if (number == VK_SHIFT) hasShift = true;
-		else if (number == VK_CONTROL) hasCtrl = true;
-		else if (number == VK_MENU) hasAlt = true;
+			if (!measure->queryResult.empty()) measure->queryResult += L'|';
+			measure->queryResult += found->name;
+			measure->queryResult += L'=';
+			measure->queryResult += found->keys;
+		}
 	}
 
-	// Sort lowest to highest
-	std::sort(measure->virtualKeys.begin(), measure->virtualKeys.end());
+	return measure->queryResult.c_str();
+}
 
-	// Remove duplicates
-	measure->virtualKeys.erase(std::unique(measure->virtualKeys.begin(), measure->virtualKeys.end()), measure->virtualKeys.end());
+// [&Measure:GetStat(Name)] - Startup counters: Measures, Parses, HookRequests, HookStarts, InitTime
+// and StartupTime (in milliseconds)
+PLUGIN_EXPORT LPCWSTR GetStat(void* data, const int argc, const WCHAR* argv[])
+{
+	Measure* measure = (Measure*)data;
+	measure->queryResult.clear();
 
-	// Remove any L/R variations (only if the HotKey has the generic modifier)
-	// ie. SHIFT overrides LSHIFT
-	auto remove = [&](const bool modifier, const short key) -> void
+	if (argc == 1)
 	{
-		if (modifier)
-		{
-			measure->virtualKeys.erase(
-				std::remove(measure->virtualKeys.begin(), measure->virtualKeys.end(), key),
-				measure->virtualKeys.end());
-		}
-	};
+		const EngineStats& stats = GetEngineStats();
+
+		if (_wcsicmp(argv[0], L"Measures") == 0) measure->queryResult = std::to_wstring(stats.measures);
+		else if (_wcsicmp(argv[0], L"Parses") == 0) measure->queryResult = std::to_wstring(stats.parses);
+		else if (_wcsicmp(argv[0], L"HookRequests") == 0) measure->queryResult = std::to_wstring(stats.backendRequests);
+		else if (_wcsicmp(argv[0], L"HookStarts") == 0) measure->queryResult = std::to_wstring(stats.backendStarts);
+		else if (_wcsicmp(argv[0], L"InitTime") == 0) measure->queryResult = std::to_wstring(stats.initTime);
+		else if (_wcsicmp(argv[0], L"StartupTime") == 0) measure->queryResult = std::to_wstring(stats.startupTime);
+	}
 
-	remove(hasShift, VK_LSHIFT);
-	remove(hasShift, VK_RSHIFT);
-	remove(hasCtrl, VK_LCONTROL);
-	remove(hasCtrl, VK_RCONTROL);
-	remove(hasAlt, VK_LMENU);
-	remove(hasAlt, VK_RMENU);
+	return measure->queryResult.c_str();
+}
+
+/*
+** Restarts the delay each time it is called, so that a burst of measures only starts the hook once.
+*/
+void ScheduleBackendStart()
+{
+	if (g_StartTimer)
+	{
+		KillTimer(nullptr, g_StartTimer);
+	}
 
-	measure->virtualKeys.shrink_to_fit();
+	g_StartTimer = SetTimer(nullptr, 0, g_StartDelay, StartTimerProc);
+	if (!g_StartTimer)
+	{
+		StartTimerProc(nullptr, 0, 0, 0);
+	}
 }
 
-LRESULT CALLBACK LLKeyboardProc(int nCode, WPARAM wParam, LPARAM lParam)
+void CALLBACK StartTimerProc(HWND hwnd, UINT uMsg, UINT_PTR idEvent, DWORD dwTime)
 {
-	if (nCode >= 0)
+	if (g_StartTimer)
 	{
-		KBDLLHOOKSTRUCT* kbdStruct = reinterpret_cast<KBDLLHOOKSTRUCT*>(lParam);
+		KillTimer(nullptr, g_StartTimer);
+		g_StartTimer = 0;
+	}
 
-		auto doAction = [&](const bool isUpMeasure) -> void
+	// As before the start was deferred, each waiting measure logs the error to its own skin and
+	// gives up its keys
+	if (!StartBackend())
+	{
+		for (const auto& measure : GetBackendMeasures())
 		{
-			for (auto& measure : (isUpMeasure ? g_UpMeasures : g_DownMeasures))
+			RmLogF(measure->rm, LOG_ERROR, g_ErrHook, L"start");
+			if (!RemoveMeasure(measure))
 			{
-				// Log keystoke if needed
-				if (measure->showAllKeys)
-				{
-					WCHAR text[32];
-					DWORD dwCode = MapVirtualKey(kbdStruct->vkCode, 0) << 16;
-					if (GetKeyNameText(dwCode, text, sizeof(text) / sizeof(WCHAR)) == 0)
-					{
-						dwCode |= (1 << 24);
-						if (GetKeyNameText(dwCode, text, sizeof(text) / sizeof(WCHAR)) == 0)
-						{
-							wcsncpy_s(text, L"Unknown Key", 32);
-						}
-					}
-					RmLogF(measure->rm, LOG_NOTICE, L"Key: %s, Hex: 0x%X (%i), Scan Code: 0x%X (%i), State: %s, Time: %i",
-						text, kbdStruct->vkCode, kbdStruct->vkCode, kbdStruct->scanCode, kbdStruct->scanCode,
-						isUpMeasure ? L"Up" : L"Down", kbdStruct->time);
-				}
-
-				// Only execute if the measure is active
-				if (measure->isActive)
-				{
-					if (std::find(measure->virtualKeys.begin(), measure->virtualKeys.end(), (short)kbdStruct->vkCode) != measure->virtualKeys.end())
-					{
-						bool executeAction = true;
-						for (const auto& key : measure->virtualKeys)
-						{
-							if (key != (short)kbdStruct->vkCode && (!(GetAsyncKeyState(key) & 0x8000)))
-							{
-								executeAction = false;
-								break;
-							}
-						}
-
-						// Handle toggle keys.
-						// MSDN states that the low-order bit of the return value of GetKeyState will indicate
-						// if the toggle is "on" or not, however after some testing, it seems it more complicated
-						// when the toggle key is held down, in which the low-order bit seems to be reversed.
-						// Instead of testing the low-order bit, just test for 0 and -127. This may need to be
-						// updated in the future.
-						if (measure->hasToggle)
-						{
-							const short state = GetKeyState(measure->virtualKeys[0]);
-							measure->toggle = state == 0 || state == -127 ? true : false;
-
-						}
-
-						// Since toggle keys are added to the "Down" measures no matter what,
-						// make sure there is a down "Action" before executing.
-						if (executeAction && (isUpMeasure || !measure->downAction.empty()))
-						{
-							RmExecute(measure->skin, isUpMeasure ?
-								measure->upAction.c_str() :
-								measure->downAction.c_str());
-						}
-					}
-				}
+				RmLogF(measure->rm, LOG_ERROR, g_ErrHook, L"stop");
 			}
-		};
-
-		switch (wParam)
-		{
-		case WM_SYSKEYUP:
-		case WM_KEYUP:
-			doAction(true);
-			break;
-
-		case WM_SYSKEYDOWN:
-		case WM_KEYDOWN:
-			doAction(false);
-			break;
 		}
 	}
+}
 
-	return CallNextHookEx(g_Hook, nCode, wParam, lParam);
+void ExecuteAction(Measure* measure, const std::wstring& action)
+{
+	RmExecute(measure->skin, action.c_str());
+}
+
+void LogKey(Measure* measure, const WCHAR* message)
+{
+	RmLog(measure->rm, LOG_NOTICE, message);
 }
@@ -19,13 +19,21 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #ifndef __STDAFX_H__
 #define __STDAFX_H__
 
+#ifdef _WIN32
+#define PSAPI_VERSION 1
+
 #include <Windows.h>
+#include <Psapi.h>
+#else
+#include "KeyCodes.h"
+#endif
+
 #include <algorithm>
+#include <cwchar>
 #include <cwctype>
+#include <map>
+#include <set>
 #include <string>
 #include <vector>
 
-
-#include "../RainmeterAPI/RainmeterAPI.h"
-
 #endif
@@ -0,0 +1,227 @@
+/*
+Copyright (C) 2014 Brian Ferguson
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "Win32Backend.h"
+
+#ifndef PROCESS_QUERY_LIMITED_INFORMATION
+#define PROCESS_QUERY_LIMITED_INFORMATION 0x1000
+#endif
+
+HHOOK Win32Backend::c_Hook = nullptr;
+
+Win32Backend::Win32Backend() :
+	m_Instance(nullptr),
+	m_EventHook(nullptr),
+	m_Layout(nullptr),
+	m_LayoutCache()
+{
+}
+
+Win32Backend::~Win32Backend()
+{
+	Stop();
+	WatchForeground(false);
+}
+
+void Win32Backend::Initialize()
+{
+	BuildLayoutCache(GetKeyboardLayout(0));
+}
+
+bool Win32Backend::Start()
+{
+	if (!c_Hook)
+	{
+		c_Hook = SetWindowsHookEx(WH_KEYBOARD_LL, LLKeyboardProc, m_Instance, 0);
+	}
+
+	return c_Hook != nullptr;
+}
+
+bool Win32Backend::Stop()
+{
+	if (c_Hook)
+	{
+		if (UnhookWindowsHookEx(c_Hook) == FALSE)
+		{
+			return false;
+		}
+
+		c_Hook = nullptr;
+	}
+
+	return true;
+}
+
+bool Win32Backend::WatchForeground(const bool watch)
+{
+	if (watch && !m_EventHook)
+	{
+		m_EventHook = SetWinEventHook(EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND, nullptr,
+			ForegroundEventProc, 0, 0, WINEVENT_OUTOFCONTEXT);
+		if (!m_EventHook)
+		{
+			return false;
+		}
+
+		OnForegroundChanged(GetForegroundInfo(GetForegroundWindow()));
+	}
+	else if (!watch && m_EventHook)
+	{
+		UnhookWinEvent(m_EventHook);
+		m_EventHook = nullptr;
+	}
+
+	return true;
+}
+
+bool Win32Backend::IsKeyDown(const short vk)
+{
+	return (GetAsyncKeyState(vk) & 0x8000) != 0;
+}
+
+bool Win32Backend::GetToggleState(const short vk, const bool isKeyEvent)
+{
+	const short state = GetKeyState(vk);
+	if (!isKeyEvent)
+	{
+		return LOWORD(state) ? true : false;
+	}
+
+	// MSDN states that the low-order bit of the return value of GetKeyState will indicate
+	// if the toggle is "on" or not, however after some testing, it seems it more complicated
+	// when the toggle key is held down, in which the low-order bit seems to be reversed.
+	// Instead of testing the low-order bit, just test for 0 and -127. This may need to be
+	// updated in the future.
+	return state == 0 || state == -127 ? true : false;
+}
+
+short Win32Backend::CharToKey(const WCHAR ch)
+{
+	const HKL layout = GetKeyboardLayout(0);
+	if ((size_t)ch < _countof(m_LayoutCache))
+	{
+		if (layout != m_Layout)
+		{
+			BuildLayoutCache(layout);
+		}
+
+		return m_LayoutCache[ch];
+	}
+
+	const short result = VkKeyScanEx(ch, layout);
+	return result == -1 ? -1 : LOBYTE(result);
+}
+
+void Win32Backend::BuildLayoutCache(HKL layout)
+{
+	for (size_t ch = 0; ch < _countof(m_LayoutCache); ++ch)
+	{
+		const short result = VkKeyScanEx((WCHAR)ch, layout);
+		m_LayoutCache[ch] = result == -1 ? -1 : LOBYTE(result);
+	}
+
+	m_Layout = layout;
+}
+
+void Win32Backend::GetKeyName(const KeyEvent& event, WCHAR* buffer, const size_t size)
+{
+	DWORD dwCode = MapVirtualKey(event.vk, 0) << 16;
+	if (GetKeyNameText(dwCode, buffer, (int)size) == 0)
+	{
+		dwCode |= (1 << 24);
+		if (GetKeyNameText(dwCode, buffer, (int)size) == 0)
+		{
+			wcsncpy_s(buffer, size, L"Unknown Key", _TRUNCATE);
+		}
+	}
+}
+
+ForegroundInfo Win32Backend::GetForegroundInfo(HWND hwnd)
+{
+	ForegroundInfo foreground;
+
+	if (hwnd)
+	{
+		WCHAR buffer[MAX_PATH];
+		if (GetClassName(hwnd, buffer, _countof(buffer)) > 0)
+		{
+			foreground.windowClass = buffer;
+		}
+
+		DWORD processId = 0;
+		GetWindowThreadProcessId(hwnd, &processId);
+
+		// PROCESS_QUERY_LIMITED_INFORMATION is needed for elevated processes, but does not exist on XP
+		HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId);
+		if (!process)
+		{
+			process = OpenProcess(PROCESS_QUERY_INFORMATION, FALSE, processId);
+		}
+
+		if (process)
+		{
+			if (GetProcessImageFileName(process, buffer, _countof(buffer)) > 0)
+			{
+				const WCHAR* name = wcsrchr(buffer, L'\\');
+				foreground.process = name ? name + 1 : buffer;
+			}
+
+			CloseHandle(process);
+		}
+	}
+
+	return foreground;
+}
+
+LRESULT CALLBACK Win32Backend::LLKeyboardProc(int nCode, WPARAM wParam, LPARAM lParam)
+{
+	if (nCode >= 0)
+	{
+		KBDLLHOOKSTRUCT* kbdStruct = reinterpret_cast<KBDLLHOOKSTRUCT*>(lParam);
+
+		KeyEvent event;
+		event.vk = (short)kbdStruct->vkCode;
+		event.scanCode = kbdStruct->scanCode;
+		event.time = kbdStruct->time;
+
+		switch (wParam)
+		{
+		case WM_SYSKEYUP:
+		case WM_KEYUP:
+			event.isUp = true;
+			OnKeyEvent(event);
+			break;
+
+		case WM_SYSKEYDOWN:
+		case WM_KEYDOWN:
+			OnKeyEvent(event);
+			break;
+		}
+	}
+
+	return CallNextHookEx(c_Hook, nCode, wParam, lParam);
+}
+
+void CALLBACK Win32Backend::ForegroundEventProc(HWINEVENTHOOK hWinEventHook, DWORD event, HWND hwnd, LONG idObject, LONG idChild, DWORD dwEventThread, DWORD dwmsEventTime)
+{
+	if (event == EVENT_SYSTEM_FOREGROUND)
+	{
+		OnForegroundChanged(GetForegroundInfo(hwnd));
+	}
+}
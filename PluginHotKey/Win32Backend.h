@@ -0,0 +1,62 @@
+/*
+Copyright (C) 2014 Brian Ferguson
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef __WIN32BACKEND_H__
+#define __WIN32BACKEND_H__
+
+#include "InputBackend.h"
+
+/*
+** Backend using a low-level keyboard hook (WH_KEYBOARD_LL) and a foreground WinEvent hook. Both
+** hooks call back on the thread that started them, which must have a message loop.
+*/
+class Win32Backend : public InputBackend
+{
+public:
+	Win32Backend();
+	virtual ~Win32Backend();
+
+	void SetInstance(HINSTANCE instance) { m_Instance = instance; }
+
+	virtual void Initialize();
+	virtual bool Start();
+	virtual bool Stop();
+	virtual bool WatchForeground(const bool watch);
+	virtual bool IsKeyDown(const short vk);
+	virtual bool GetToggleState(const short vk, const bool isKeyEvent);
+	virtual short CharToKey(const WCHAR ch);
+	virtual void GetKeyName(const KeyEvent& event, WCHAR* buffer, const size_t size);
+
+private:
+	static ForegroundInfo GetForegroundInfo(HWND hwnd);
+
+	void BuildLayoutCache(HKL layout);
+
+	static LRESULT CALLBACK LLKeyboardProc(int nCode, WPARAM wParam, LPARAM lParam);
+	static void CALLBACK ForegroundEventProc(HWINEVENTHOOK hWinEventHook, DWORD event, HWND hwnd, LONG idObject, LONG idChild, DWORD dwEventThread, DWORD dwmsEventTime);
+
+	static HHOOK c_Hook;
+
+	HINSTANCE m_Instance;
+	HWINEVENTHOOK m_EventHook;
+
+	HKL m_Layout;
+	short m_LayoutCache[128];			// VkKeyScanEx results for ASCII characters in m_Layout
+};
+
+#endif
@@ -0,0 +1,128 @@
+/*
+Copyright (C) 2014 Brian Ferguson
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+** Fuzzes the "HotKey" option: the input is parsed as the option value, registered as a measure, and
+** every parsed key plus every input byte is then pressed and released through a fake backend.
+*/
+
+#include "HotKey.h"
+#include "InputBackend.h"
+#include <cstdint>
+#include <cstring>
+
+class FuzzBackend : public InputBackend
+{
+public:
+	FuzzBackend()
+	{
+		memset(m_KeyState, 0, sizeof(m_KeyState));
+	}
+
+	virtual bool Start() { return true; }
+	virtual bool Stop() { return true; }
+	virtual bool WatchForeground(const bool watch) { if (watch) OnForegroundChanged(ForegroundInfo()); return true; }
+	virtual bool IsKeyDown(const short vk) { return vk >= 0 && vk < 256 && m_KeyState[vk]; }
+	virtual bool GetToggleState(const short vk, const bool /*isKeyEvent*/) { return IsKeyDown(vk); }
+
+	virtual short CharToKey(const WCHAR ch)
+	{
+		if (ch >= L'a' && ch <= L'z') return (short)(ch - L'a' + 'A');
+		if ((ch >= L'A' && ch <= L'Z') || (ch >= L'0' && ch <= L'9') || ch == L' ') return (short)ch;
+		return -1;
+	}
+
+	virtual void GetKeyName(const KeyEvent& event, WCHAR* buffer, const size_t size)
+	{
+		swprintf(buffer, size, L"VK%i", event.vk);
+	}
+
+	void Send(const short vk, const bool isUp)
+	{
+		if (vk < 0 || vk >= 256) return;
+		m_KeyState[vk] = !isUp;
+
+		KeyEvent event;
+		event.vk = vk;
+		event.scanCode = 0;
+		event.time = 0;
+		event.isUp = isUp;
+		OnKeyEvent(event);
+	}
+
+private:
+	bool m_KeyState[256];
+};
+
+static size_t g_Executed = 0;
+
+void ExecuteAction(Measure* /*measure*/, const std::wstring& /*action*/)
+{
+	++g_Executed;
+}
+
+void LogKey(Measure* /*measure*/, const WCHAR* /*message*/)
+{
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+	static FuzzBackend backend;
+	SetInputBackend(&backend);
+
+	// Bytes are taken as Latin-1 so every input is a valid option value
+	const std::wstring keys(data, data + size);
+
+	std::vector<short> virtualKeys;
+	std::wstring invalidKey;
+	const ParseResult result = ParseChord(keys, virtualKeys, invalidKey);
+	if (result == PARSE_OK && virtualKeys.size() > MAX_HOTKEY_KEYS) __builtin_trap();
+	if (result != PARSE_OK && !virtualKeys.empty()) __builtin_trap();
+
+	Measure* measure = new Measure;
+	measure->config = L"Fuzz";
+	measure->name = L"Measure";
+	measure->keys = keys;
+	measure->upAction = measure->downAction = L"!Log";
+	measure->showAllKeys = (size % 2) != 0;
+	AddMeasure(measure);
+
+	if (ParseKeys(measure, invalidKey) == PARSE_OK)
+	{
+		UpdateScope(measure);
+		UpdateMeasureLists(measure);
+		StartBackend();
+
+		// Every non-empty chord must be found again by its own text
+		if (!measure->hasToggle && !measure->virtualKeys.empty() && FindChord(keys) == nullptr) __builtin_trap();
+
+		for (const auto& vk : measure->virtualKeys) backend.Send(vk, false);
+		for (size_t i = 0; i < size; ++i) backend.Send(data[i], (data[i] & 1) != 0);
+		for (const auto& vk : measure->virtualKeys) backend.Send(vk, true);
+	}
+
+	DeleteMeasure(measure);
+	delete measure;
+
+	for (short vk = 0; vk < 256; ++vk)
+	{
+		if (backend.IsKeyDown(vk)) backend.Send(vk, true);
+	}
+
+	return 0;
+}
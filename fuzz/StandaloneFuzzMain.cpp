@@ -0,0 +1,95 @@
+/*
+Copyright (C) 2014 Brian Ferguson
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+** Replays corpus files and directories through LLVMFuzzerTestOneInput for compilers without
+** libFuzzer. Arguments starting with '-' (libFuzzer flags) are ignored.
+*/
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+static bool RunFile(const std::string& path)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file) return false;
+
+	std::vector<uint8_t> data;
+	uint8_t buffer[4096];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+	{
+		data.insert(data.end(), buffer, buffer + read);
+	}
+	fclose(file);
+
+	LLVMFuzzerTestOneInput(data.data(), data.size());
+	return true;
+}
+
+static int RunPath(const std::string& path)
+{
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0) return -1;
+	if (!S_ISDIR(info.st_mode)) return RunFile(path) ? 1 : -1;
+
+	DIR* dir = opendir(path.c_str());
+	if (!dir) return -1;
+
+	int count = 0;
+	while (struct dirent* entry = readdir(dir))
+	{
+		if (entry->d_name[0] == '.') continue;
+		const int result = RunPath(path + '/' + entry->d_name);
+		if (result < 0)
+		{
+			count = -1;
+			break;
+		}
+		count += result;
+	}
+	closedir(dir);
+	return count;
+}
+
+int main(int argc, char* argv[])
+{
+	int count = 0;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (argv[i][0] == '-') continue;
+
+		const int result = RunPath(argv[i]);
+		if (result < 0)
+		{
+			fprintf(stderr, "Could not read %s\n", argv[i]);
+			return 1;
+		}
+		count += result;
+	}
+
+	printf("Ran %i inputs\n", count);
+	return 0;
+}
@@ -0,0 +1,510 @@
+/*
+Copyright (C) 2014 Brian Ferguson
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+** Drives the engine through LinuxBackend with evdev events written to a pipe.
+*/
+
+#include "HotKey.h"
+#include "LinuxBackend.h"
+#include <cstdio>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <unistd.h>
+
+static int g_Failures = 0;
+static std::vector<std::wstring> g_Actions;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); ++g_Failures; } } while (false)
+
+void ExecuteAction(Measure* /*measure*/, const std::wstring& action)
+{
+	g_Actions.push_back(action);
+}
+
+void LogKey(Measure* /*measure*/, const WCHAR* /*message*/)
+{
+}
+
+// Pipe standing in for /dev/input/eventN
+struct EventPipe
+{
+	int fds[2];
+
+	EventPipe()
+	{
+		if (pipe(fds) != 0) fds[0] = fds[1] = -1;
+		fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	}
+
+	~EventPipe()
+	{
+		close(fds[0]);
+		if (fds[1] >= 0) close(fds[1]);
+	}
+
+	void Send(const unsigned short code, const int value)
+	{
+		struct input_event events[2] = {};
+		events[0].type = EV_KEY;
+		events[0].code = code;
+		events[0].value = value;
+		events[1].type = EV_SYN;
+		if (write(fds[1], events, sizeof(events)) != sizeof(events)) ++g_Failures;
+	}
+
+	void CloseWriter()
+	{
+		close(fds[1]);
+		fds[1] = -1;
+	}
+};
+
+// Backend that records whether the engine is watching the foreground window
+class WatchRecordingBackend : public LinuxBackend
+{
+public:
+	WatchRecordingBackend(int fd) : LinuxBackend(fd), isWatching(false) { }
+
+	virtual bool WatchForeground(const bool watch)
+	{
+		isWatching = watch;
+		return LinuxBackend::WatchForeground(watch);
+	}
+
+	bool isWatching;
+};
+
+static Measure* CreateMeasure(void* skin, const WCHAR* name, const WCHAR* keys, const WCHAR* config = L"Test")
+{
+	Measure* measure = new Measure;
+	measure->skin = skin;
+	measure->config = config;
+	measure->name = name;
+	measure->keys = keys;
+	measure->downAction = std::wstring(name) + L" down";
+	measure->upAction = std::wstring(name) + L" up";
+	AddMeasure(measure);
+
+	std::wstring invalidKey;
+	ParseKeys(measure, invalidKey);
+	UpdateScope(measure);
+	UpdateMeasureLists(measure);
+	StartBackend();
+
+	return measure;
+}
+
+static void DestroyMeasure(Measure* measure)
+{
+	DeleteMeasure(measure);
+	delete measure;
+}
+
+// Backend whose Stop() fails on demand, like a failed UnhookWindowsHookEx
+class StopFailingBackend : public LinuxBackend
+{
+public:
+	StopFailingBackend(int fd) : LinuxBackend(fd), isStopFailing(true), stops(0) { }
+
+	virtual bool Stop()
+	{
+		++stops;
+		return !isStopFailing && LinuxBackend::Stop();
+	}
+
+	bool isStopFailing;
+	int stops;
+};
+
+static void TestChord()
+{
+	EventPipe events;
+	LinuxBackend backend(events.fds[0]);
+	SetInputBackend(&backend);
+	g_Actions.clear();
+
+	Measure* measure = CreateMeasure(nullptr, L"X", L"CTRL ALT X");
+
+	// X alone does nothing
+	events.Send(KEY_X, 1);
+	events.Send(KEY_X, 0);
+	CHECK(backend.Dispatch() == 2);
+	CHECK(g_Actions.empty());
+
+	// Either side of the generic modifiers matches
+	events.Send(KEY_RIGHTCTRL, 1);
+	events.Send(KEY_LEFTALT, 1);
+	events.Send(KEY_X, 1);
+	events.Send(KEY_X, 2);
+	events.Send(KEY_X, 0);
+	CHECK(backend.Dispatch() == 5);
+	CHECK(g_Actions.size() == 3 && g_Actions[0] == L"X down" && g_Actions[1] == L"X down" && g_Actions[2] == L"X up");
+
+	// Releasing a modifier breaks the chord
+	g_Actions.clear();
+	events.Send(KEY_LEFTALT, 0);
+	events.Send(KEY_X, 1);
+	backend.Dispatch();
+	CHECK(g_Actions.empty());
+
+	DestroyMeasure(measure);
+
+	events.CloseWriter();
+	CHECK(backend.Dispatch() == -1);
+}
+
+static void TestToggle()
+{
+	EventPipe events;
+	LinuxBackend backend(events.fds[0]);
+	SetInputBackend(&backend);
+
+	Measure* measure = CreateMeasure(nullptr, L"Caps", L"CapsLock Status");
+	CHECK(measure->hasToggle);
+	CHECK(!measure->toggle);
+
+	events.Send(KEY_CAPSLOCK, 1);
+	events.Send(KEY_CAPSLOCK, 0);
+	backend.Dispatch();
+	CHECK(measure->toggle);
+
+	events.Send(KEY_CAPSLOCK, 1);
+	backend.Dispatch();
+	CHECK(!measure->toggle);
+
+	DestroyMeasure(measure);
+}
+
+static void TestKeyCodes()
+{
+	CHECK(LinuxBackend::KeyCodeToVirtualKey(KEY_A) == 'A');
+	CHECK(LinuxBackend::KeyCodeToVirtualKey(KEY_0) == '0');
+	CHECK(LinuxBackend::KeyCodeToVirtualKey(KEY_LEFTMETA) == VK_LWIN);
+	CHECK(LinuxBackend::KeyCodeToVirtualKey(KEY_KP5) == VK_NUMPAD5);
+	CHECK(LinuxBackend::KeyCodeToVirtualKey(BTN_LEFT) == VK_LBUTTON);
+	CHECK(LinuxBackend::KeyCodeToVirtualKey(KEY_MAX + 1) == 0);
+}
+
+static void TestParseChord()
+{
+	LinuxBackend backend(-1);
+	SetInputBackend(&backend);
+
+	std::vector<short> virtualKeys;
+	std::wstring invalidKey;
+	CHECK(ParseChord(L"ctrl LCTRL  0x41", virtualKeys, invalidKey) == PARSE_OK);
+	CHECK(virtualKeys.size() == 2 && virtualKeys[0] == VK_CONTROL && virtualKeys[1] == 'A');
+
+	CHECK(ParseChord(L"CTRL NOTAKEY", virtualKeys, invalidKey) == PARSE_INVALID_KEY);
+	CHECK(invalidKey == L"NOTAKEY");
+	CHECK(virtualKeys.empty());
+
+	CHECK(ParseChord(L"0x1FF", virtualKeys, invalidKey) == PARSE_INVALID_KEY);
+	CHECK(ParseChord(L"ABCDEFGHIJKLMNOPQRSTUVWXYZ", virtualKeys, invalidKey) == PARSE_INVALID_KEY);
+	CHECK(invalidKey == L"ABCDEFGHIJKLMNOP...");
+
+	std::wstring keys;
+	for (size_t i = 0; i <= MAX_HOTKEY_KEYS; ++i) keys += L"A ";
+	CHECK(ParseChord(keys, virtualKeys, invalidKey) == PARSE_TOO_MANY_KEYS);
+	CHECK(virtualKeys.empty());
+}
+
+static void TestStopFailure()
+{
+	EventPipe events;
+	StopFailingBackend backend(events.fds[0]);
+	SetInputBackend(&backend);
+
+	Measure* measure = CreateMeasure(nullptr, L"Stop", L"F7");
+
+	// A failed stop is reported and the backend is still treated as active
+	CHECK(!RemoveMeasure(measure));
+	CHECK(backend.stops == 1);
+	CHECK(UpdateMeasureLists(measure));
+	CHECK(!IsBackendNeeded());
+
+	// The next removal tries again
+	measure->upAction.clear();
+	measure->downAction.clear();
+	CHECK(!UpdateMeasureLists(measure));
+	CHECK(backend.stops == 2);
+
+	measure->downAction = L"Stop down";
+	CHECK(UpdateMeasureLists(measure));
+	backend.isStopFailing = false;
+	CHECK(DeleteMeasure(measure));
+	CHECK(backend.stops == 3);
+	delete measure;
+
+	// Nothing is left running, so the next measure starts the backend again
+	measure = CreateMeasure(nullptr, L"Stop", L"F7");
+	CHECK(!IsBackendNeeded());
+	CHECK(DeleteMeasure(measure));
+	CHECK(backend.stops == 4);
+	delete measure;
+}
+
+static bool HasMeasure(const std::vector<Measure*>* measures, const Measure* measure)
+{
+	return measures && std::find(measures->begin(), measures->end(), measure) != measures->end();
+}
+
+static void TestIndex()
+{
+	LinuxBackend backend(-1);
+	SetInputBackend(&backend);
+
+	int skinA = 0, skinB = 0;
+	Measure* a = CreateMeasure(&skinA, L"MeasureA", L"CTRL ALT X", L"Suite\\Clock");
+	Measure* b = CreateMeasure(&skinB, L"MeasureB", L"alt ctrl 0x58", L"Suite\\Notes");
+	Measure* c = CreateMeasure(&skinB, L"MeasureC", L"F8", L"Suite\\Notes");
+
+	// Chords are compared after parsing
+	const std::vector<Measure*>* measures = FindChord(L"alt ctrl 0x58");
+	CHECK(measures && measures->size() == 2);
+	CHECK(HasMeasure(measures, a) && HasMeasure(measures, b));
+	CHECK(FindChord(L"CTRL ALT X") == measures);
+	CHECK(FindChord(L"CTRL X") == nullptr);
+	CHECK(FindChord(L"CTRL NOTAKEY") == nullptr);
+
+	// Config and measure names are case-insensitive
+	CHECK(FindMeasure(L"suite\\clock", L"measurea") == a);
+	CHECK(FindMeasure(L"SUITE\\NOTES", L"MeasureC") == c);
+	CHECK(FindMeasure(L"Suite\\Clock", L"MeasureB") == nullptr);
+	CHECK(FindSkin(L"suite\\notes") && FindSkin(L"suite\\notes")->size() == 2);
+
+	// Re-parsing moves the measure to its new chord
+	std::wstring invalidKey;
+	b->keys = L"SHIFT F8";
+	CHECK(ParseKeys(b, invalidKey) == PARSE_OK);
+	measures = FindChord(L"CTRL ALT X");
+	CHECK(measures && measures->size() == 1 && HasMeasure(measures, a));
+	CHECK(HasMeasure(FindChord(L"F8 SHIFT"), b));
+	CHECK(!HasMeasure(FindChord(L"F8"), b));
+
+	// A failed parse or a removed "HotKey" option leaves the index, but not the skin
+	a->keys = L"CTRL ALT NOTAKEY";
+	CHECK(ParseKeys(a, invalidKey) == PARSE_INVALID_KEY);
+	CHECK(FindChord(L"CTRL ALT X") == nullptr);
+
+	ClearKeys(b);
+	CHECK(FindChord(L"SHIFT F8") == nullptr);
+	CHECK(FindMeasure(L"Suite\\Notes", L"MeasureB") == b);
+
+	// Unloading the last measure of a skin removes the skin
+	DestroyMeasure(a);
+	CHECK(FindMeasure(L"Suite\\Clock", L"MeasureA") == nullptr);
+	CHECK(FindSkin(L"Suite\\Clock") == nullptr);
+
+	DestroyMeasure(b);
+	CHECK(FindMeasure(L"Suite\\Notes", L"MeasureB") == nullptr);
+	CHECK(FindSkin(L"Suite\\Notes") && FindSkin(L"Suite\\Notes")->size() == 1);
+	CHECK(HasMeasure(FindChord(L"F8"), c));
+
+	DestroyMeasure(c);
+	CHECK(FindSkin(L"Suite\\Notes") == nullptr);
+	CHECK(FindChord(L"F8") == nullptr);
+}
+
+static void TestWildcard()
+{
+	CHECK(MatchWildcard(L"notepad.exe", L"NotePad.EXE"));
+	CHECK(MatchWildcard(L"*code*.exe", L"VSCode-Insiders.exe"));
+	CHECK(MatchWildcard(L"note?ad.exe", L"notepad.exe"));
+	CHECK(!MatchWildcard(L"note?ad.exe", L"notead.exe"));
+	CHECK(MatchWildcard(L"*", L""));
+	CHECK(MatchWildcard(L"", L""));
+	CHECK(!MatchWildcard(L"", L"notepad.exe"));
+	CHECK(!MatchWildcard(L"?", L""));
+	CHECK(!MatchWildcard(L"*.exe", L"notepad.ex"));
+}
+
+static void TestScopeLists()
+{
+	Measure measure;
+	ForegroundInfo foreground;
+	foreground.process = L"firefox.exe";
+	foreground.windowClass = L"MozillaWindowClass";
+
+	CHECK(IsInScope(&measure, foreground));
+
+	measure.processes.push_back(L"chrome.exe");
+	measure.processes.push_back(L"FIREFOX.*");
+	CHECK(IsInScope(&measure, foreground));
+
+	// Both lists must match
+	measure.windowClasses.push_back(L"Chrome_*");
+	CHECK(!IsInScope(&measure, foreground));
+
+	measure.windowClasses.push_back(L"Mozilla*");
+	CHECK(IsInScope(&measure, foreground));
+
+	measure.processes.clear();
+	measure.processes.push_back(L"chrome.exe");
+	CHECK(!IsInScope(&measure, foreground));
+
+	// An unknown foreground (ie. the process could not be opened) only matches "*"
+	CHECK(!IsInScope(&measure, ForegroundInfo()));
+}
+
+static void TestGroups()
+{
+	LinuxBackend backend(-1);
+	SetInputBackend(&backend);
+
+	int skinA = 0, skinB = 0;
+	Measure* a = CreateMeasure(&skinA, L"A", L"A", L"SkinA");
+	Measure* b = CreateMeasure(&skinB, L"B", L"B", L"SkinB");
+	a->groups.push_back(L"KEYS");
+	b->groups.push_back(L"KEYS");
+	UpdateScope(a);
+	UpdateScope(b);
+
+	SetGroupState(a, L"Keys", 0);
+	CHECK(!a->isGroupActive);
+	CHECK(b->isGroupActive);
+
+	SetGroupState(b, L"keys", -1);
+	CHECK(!a->isGroupActive);
+	CHECK(!b->isGroupActive);
+
+	SetGroupState(a, L"KEYS", -1);
+	CHECK(a->isGroupActive);
+	CHECK(!b->isGroupActive);
+
+	SetGroupState(b, L"Keys", 1);
+	CHECK(b->isGroupActive);
+
+	// Stopped groups are kept while the skin has measures, and forgotten when it is unloaded
+	SetGroupState(a, L"Keys", 0);
+	Measure* a2 = CreateMeasure(&skinA, L"A2", L"B", L"SkinA");
+	a2->groups.push_back(L"KEYS");
+	UpdateScope(a2);
+	CHECK(!a2->isGroupActive);
+
+	DestroyMeasure(a);
+	DestroyMeasure(a2);
+	a = CreateMeasure(&skinA, L"A", L"A", L"SkinA");
+	a->groups.push_back(L"KEYS");
+	UpdateScope(a);
+	CHECK(a->isGroupActive);
+
+	DestroyMeasure(a);
+	DestroyMeasure(b);
+}
+
+static void TestForeground()
+{
+	EventPipe events;
+	WatchRecordingBackend backend(events.fds[0]);
+	SetInputBackend(&backend);
+	g_Actions.clear();
+
+	ForegroundInfo editor;
+	editor.process = L"Code.exe";
+	editor.windowClass = L"Chrome_WidgetWin_1";
+	ForegroundInfo browser;
+	browser.process = L"firefox.exe";
+	backend.SetForeground(browser);
+
+	Measure* scoped = new Measure;
+	scoped->config = L"Test";
+	scoped->name = L"Scoped";
+	scoped->keys = L"F5";
+	scoped->downAction = L"Scoped down";
+	scoped->processes.push_back(L"code*");
+	AddMeasure(scoped);
+
+	std::wstring invalidKey;
+	ParseKeys(scoped, invalidKey);
+	UpdateScope(scoped);
+	UpdateMeasureLists(scoped);
+	StartBackend();
+
+	// Watching starts with the first scoped measure and reports the current foreground
+	CHECK(!scoped->isInScope);
+
+	events.Send(KEY_F5, 1);
+	backend.Dispatch();
+	CHECK(g_Actions.empty());
+
+	backend.SetForeground(editor);
+	CHECK(scoped->isInScope);
+
+	events.Send(KEY_F5, 1);
+	backend.Dispatch();
+	CHECK(g_Actions.size() == 1);
+
+	backend.SetForeground(browser);
+	CHECK(!scoped->isInScope);
+
+	// Removing the "HotKey" option drops the scope until the measure is reloaded
+	Measure* unscoped = CreateMeasure(nullptr, L"Unscoped", L"F6");
+	CHECK(backend.isWatching);
+	ClearKeys(scoped);
+	CHECK(!backend.isWatching);
+
+	scoped->keys = L"F5";
+	ParseKeys(scoped, invalidKey);
+	UpdateScope(scoped);
+	CHECK(backend.isWatching);
+
+	// Only scoped measures are recomputed, the others are always in scope
+	backend.SetForeground(browser);
+	CHECK(!scoped->isInScope);
+	CHECK(unscoped->isInScope);
+
+	scoped->processes.clear();
+	UpdateScope(scoped);
+	CHECK(scoped->isInScope);
+	CHECK(!backend.isWatching);
+
+	scoped->processes.push_back(L"code*");
+	UpdateScope(scoped);
+	CHECK(!scoped->isInScope);
+
+	// Once the last scoped measure is gone, foreground changes are no longer watched
+	DestroyMeasure(scoped);
+	CHECK(!backend.isWatching);
+
+	DestroyMeasure(unscoped);
+}
+
+int main()
+{
+	TestChord();
+	TestToggle();
+	TestKeyCodes();
+	TestParseChord();
+	TestStopFailure();
+	TestIndex();
+	TestWildcard();
+	TestScopeLists();
+	TestGroups();
+	TestForeground();
+
+	if (g_Failures != 0)
+	{
+		fprintf(stderr, "%d check(s) failed\n", g_Failures);
+		return 1;
+	}
+
+	return 0;
+}
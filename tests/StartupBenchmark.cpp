@@ -0,0 +1,149 @@
+/*
+Copyright (C) 2014 Brian Ferguson
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+** Loads a burst of skins the way Rainmeter does at startup (Initialize and Reload of every measure,
+** then one deferred StartBackend) and reports the parse, registry and teardown cost and the backend
+** starts.
+**
+** Usage: StartupBenchmark [skins] [measures per skin]
+*/
+
+#include "HotKey.h"
+#include "InputBackend.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+typedef std::chrono::steady_clock Clock;
+
+class CountingBackend : public InputBackend
+{
+public:
+	CountingBackend() : starts(0), stops(0) { }
+
+	virtual bool Start() { ++starts; return true; }
+	virtual bool Stop() { ++stops; return true; }
+	virtual bool WatchForeground(const bool /*watch*/) { return true; }
+	virtual bool IsKeyDown(const short /*vk*/) { return false; }
+	virtual bool GetToggleState(const short /*vk*/, const bool /*isKeyEvent*/) { return false; }
+	virtual short CharToKey(const WCHAR ch) { return (ch >= L'A' && ch <= L'Z') ? (short)ch : -1; }
+	virtual void GetKeyName(const KeyEvent& /*event*/, WCHAR* buffer, const size_t size) { wcsncpy(buffer, L"", size); }
+
+	int starts;
+	int stops;
+};
+
+void ExecuteAction(Measure* /*measure*/, const std::wstring& /*action*/)
+{
+}
+
+void LogKey(Measure* /*measure*/, const WCHAR* /*message*/)
+{
+}
+
+static double Milliseconds(const Clock::duration& duration)
+{
+	return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+int main(int argc, char* argv[])
+{
+	const int skins = (argc > 1) ? atoi(argv[1]) : 100;
+	const int measuresPerSkin = (argc > 2) ? atoi(argv[2]) : 10;
+	if (skins <= 0 || measuresPerSkin <= 0)
+	{
+		fprintf(stderr, "Usage: StartupBenchmark [skins] [measures per skin]\n");
+		return 1;
+	}
+
+	CountingBackend backend;
+	SetInputBackend(&backend);
+
+	const size_t keyCount = sizeof(g_VirtualKeys) / sizeof(g_VirtualKeys[0]);
+	std::vector<Measure*> measures;
+	std::vector<int> skinIds(skins);
+
+	Clock::duration registryTime = Clock::duration::zero();
+	Clock::duration parseTime = Clock::duration::zero();
+	int requests = 0;
+
+	for (int i = 0; i < skins; ++i)
+	{
+		for (int j = 0; j < measuresPerSkin; ++j)
+		{
+			Measure* measure = new Measure;
+			measure->skin = &skinIds[i];
+			measure->config = L"Skin" + std::to_wstring(i);
+			measure->name = L"Key" + std::to_wstring(j);
+			measure->keys = std::wstring(L"CTRL ALT ") + g_VirtualKeys[(i * measuresPerSkin + j) % keyCount].name;
+			measure->downAction = L"[!Log Down]";
+			measures.push_back(measure);
+
+			Clock::time_point start = Clock::now();
+			AddMeasure(measure);
+			registryTime += Clock::now() - start;
+
+			start = Clock::now();
+			std::wstring invalidKey;
+			if (ParseKeys(measure, invalidKey) != PARSE_OK)
+			{
+				fprintf(stderr, "Could not parse %ls: %ls\n", measure->keys.c_str(), invalidKey.c_str());
+				return 1;
+			}
+			parseTime += Clock::now() - start;
+
+			start = Clock::now();
+			UpdateScope(measure);
+			UpdateMeasureLists(measure);
+			if (IsBackendNeeded()) ++requests;
+			registryTime += Clock::now() - start;
+		}
+	}
+
+	// The plugin defers this until the burst is over
+	const Clock::time_point start = Clock::now();
+	StartBackend();
+	registryTime += Clock::now() - start;
+
+	// Unload every skin, in load order
+	const Clock::time_point teardownStart = Clock::now();
+	for (auto& measure : measures)
+	{
+		DeleteMeasure(measure);
+	}
+	const Clock::duration teardownTime = Clock::now() - teardownStart;
+
+	const EngineStats& stats = GetEngineStats();
+	const size_t total = measures.size();
+	printf("Measures:        %zu (%i skins x %i)\n", total, skins, measuresPerSkin);
+	printf("Parse time:      %.3f ms (%.3f us per measure)\n", Milliseconds(parseTime), Milliseconds(parseTime) * 1000.0 / total);
+	printf("Registry time:   %.3f ms (%.3f us per measure)\n", Milliseconds(registryTime), Milliseconds(registryTime) * 1000.0 / total);
+	printf("Teardown time:   %.3f ms (%.3f us per measure)\n", Milliseconds(teardownTime), Milliseconds(teardownTime) * 1000.0 / total);
+	printf("Start requests:  %i\n", requests);
+	printf("StartBackend:    %i start(s)\n", backend.starts);
+	printf("Engine stats:    %u parses, %u requests, %u starts\n", stats.parses, stats.backendRequests, stats.backendStarts);
+
+	for (auto& measure : measures)
+	{
+		delete measure;
+	}
+
+	// A burst must only start the backend once, and unloading every skin must stop it
+	return (backend.starts == 1 && backend.stops == 1) ? 0 : 1;
+}